@@ -26,14 +26,23 @@ void HDC2080::begin(){
 
 void HDC2080::read(){
 
+	startMeasurement();
+	delay(HDC2080_CONVERSION);//wait for conversion
+	readMeasurement();
+}
+
+//start conversion, read the result with readMeasurement() after HDC2080_CONVERSION
+void HDC2080::startMeasurement(){
+
 	//enable the measurement
 	Wire.beginTransmission(ADDR);
 	Wire.write(0x0f);
 	Wire.write(0x01);
 	Wire.endTransmission();
- 
-	delay(200);//wait for conversion
- 
+}
+
+void HDC2080::readMeasurement(){
+
 	Wire.beginTransmission(ADDR);
 	Wire.write(0x00);
 	Wire.endTransmission();
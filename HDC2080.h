@@ -5,12 +5,15 @@
 #define serial_debug  Serial1
 
 #define ADDR 0x40
+#define HDC2080_CONVERSION 200 //wait for conversion in millis
 
 class HDC2080{
 	public:
 		HDC2080();
 		void begin();
 		void read();
+		void startMeasurement();
+		void readMeasurement();
 		float getTemp();
 		float getHum();
 
@@ -10,11 +10,16 @@ MPU9250::MPU9250() {};
 Input: /
 Output: /
 Description:
-
+	* Restore filter state saved before sleep and bias estimates saved before power down
+	* Initialise and calibrate sensors, in six-axis mode the magnetometer stays powered down
 */
 void MPU9250::setup()
 {
 	data_delay = INNITIAL_DATA_DELAY;
+	restoreState();
+	loadBias();
+	declination_sin = sinf(magnetic_declination * PI / 180.0f);
+	declination_cos = cosf(magnetic_declination * PI / 180.0f);
 
 	uint8_t m_whoami = 0x00;
 	uint8_t a_whoami = 0x00;
@@ -45,11 +50,33 @@ void MPU9250::setup()
 		LOG(3, "MPU9250 initialized for active data mode...."); // Initialize device for active mode read of acclerometer, gyroscope, and temperature
 
 
-		a_whoami = isConnectedAK8963();
+		a_whoami = imu || isConnectedAK8963();
 		if (a_whoami)
 		{
-			initAK8963(magCalibration);
-			LOG(3, "AK8963 initialized for active data mode...."); // Initialize device for active mode read of magnetometer
+			if (imu) {
+				writeByte(AK8963_ADDRESS, AK8963_CNTL, 0x00); // Power down magnetometer
+				LOG(3, "AK8963 powered down for six-axis fusion....");
+			}
+			else {
+				initAK8963(magCalibration);
+				LOG(3, "AK8963 initialized for active data mode...."); // Initialize device for active mode read of magnetometer
+			}
+
+			if (fifo) {
+				initFifo();
+				LOG(3, "MPU9250 FIFO initialized....");
+			}
+			else if (master_read && !imu) {
+				initMaster(AK8963_ST1, 8);
+				LOG(3, "MPU9250 I2C master initialized....");
+			}
+			queue.Flush();
+			i2c.Init();
+			async_state = ASYNC_IDLE;
+
+			lastUpdate = micros(); // Do not integrate over the sleep
+			count = millis();
+			sum = 0.0f;
 		}
 		else
 		{
@@ -78,14 +105,19 @@ void MPU9250::calibrateAccelGyro()
 #pragma endregion
 
 #pragma region void MPU9250::calibrateMag()
-/* Public magnetometer calibration function
+/* Restart magnetometer calibration
 Input: /
 Output: /
-Description: Calls private magnetometer calibration function
+Description: forget the samples of the streaming calibration, e.g. after the surrounding iron has changed. Current
+             bias and scale are kept until a new fit is accepted. Not needed in six-axis mode.
 */
 void MPU9250::calibrateMag()
 {
-	magcalMPU9250(magBias, magScale);
+	if (imu) {
+		LOG(3, "Six-axis fusion, magnetometer not calibrated");
+		return;
+	}
+	mag_cal.Init();
 }
 #pragma endregion
 
@@ -124,16 +156,59 @@ bool MPU9250::isConnectedAK8963()
 Input: /
 Output: bool - was the update done?
 Description:
+	* In FIFO mode samples are taken from the drained FIFO
+	* In interrupt mode data is read only after a data-ready interrupt, its time is used for integration. If more
+	  interrupts are queued, older samples were already overwritten in the sensor and only the latest is read.
+	* Otherwise data-ready is polled
+	* In master read mode all nine axes are read with one burst
+	* In six-axis mode the magnetometer is not read
+	* In async mode the burst runs in the background and the update is done when it finished with new data
 */
 bool MPU9250::update()
 {
-	if (available())
-	{  // On interrupt, check if data ready interrupt
-		updateAccelGyro();
-		updateMag(); // TODO: set to 30fps?
+	if (fifo) {
+		return updateFifo();
+	}
+
+	if (async) {
+		if (!updateAsync()) {
+			return false;
+		}
+		Now = async_time;
+	}
+	else if (interrupt) {
+		uint32_t t;
+		if (!queue.Pop(&t)) {
+			return false;
+		}
+		while (queue.Pop(&t));
+		if (master_read && !imu) {
+			updateMaster();
+		}
+		else {
+			updateAccelGyro();
+			if (!imu) {
+				updateMag();
+			}
+		}
+		Now = t;
+	}
+	else {
+		if (available())
+		{  // On interrupt, check if data ready interrupt
+			if (master_read && !imu) {
+				updateMaster();
+			}
+			else {
+				updateAccelGyro();
+				if (!imu) {
+					updateMag(); // TODO: set to 30fps?
+				}
+			}
+		}
+		Now = micros();
 	}
 	
-	Now = micros();
 	deltat = ((Now - lastUpdate) / 1000000.0f); // set integration time by time elapsed since last filter update
 	//Serial.println((Now - lastUpdate));
 	//Serial.print(" ");
@@ -148,15 +223,7 @@ bool MPU9250::update()
 
 	if (delt_t > 10) {
 
-		updateRPY();
-
-		Acc.x = a[0];
-		Acc.y = a[1];
-		Acc.z = a[2];
-
-		Acc.rotate(&Q);
-
-		LOG(3, "%d, %d, %d, %d", sum, (int)(Acc.x * 1000), (int)(Acc.y * 1000), (int)(Acc.z * 1000));
+		rotateAcc();
 
 		count = millis();
 		sum_send = sum;
@@ -176,13 +243,37 @@ bool MPU9250::update()
 Input: /
 Output: /
 Description: 
-	* Read new MPU9250 raw data
+	* Read new MPU9250 raw data, keep previous values on read error
+	* Check if acceleration is at full scale
 	* Convert raw data to calibrated accelometer and gyro measurments
 */
 void MPU9250::updateAccelGyro()
 {
 	int16_t MPU9250Data[7]; // used to read all 14 bytes at once from the MPU9250 accel/gyro
 	readMPU9250Data(MPU9250Data); // INT cleared on any read
+	if (i2c_err_ && i2c_err_ != 7) {
+		return;
+	}
+	convertAccelGyro(MPU9250Data);
+}
+#pragma endregion
+
+#pragma region void MPU9250::convertAccelGyro(int16_t * raw)
+/* Convert accelometer and gyro data
+Input: int16_t[7] raw data - acceleration, temperature and gyro
+Output: /
+Description:
+	* Check if acceleration is at full scale
+	* Convert raw data to calibrated accelometer and gyro measurments
+*/
+void MPU9250::convertAccelGyro(int16_t * MPU9250Data)
+{
+	new_data = true;
+	for (int i = 0; i < 3; i++) {
+		if (MPU9250Data[i] == 32767 || MPU9250Data[i] == -32768) {
+			clipped = true;
+		}
+	}
 
 								  // Now we'll calculate the accleration value into actual g's
 	a[0] = (float)MPU9250Data[0] * aRes - accelBias[0];  // get actual g value, this depends on scale being set
@@ -208,18 +299,420 @@ void MPU9250::updateMag()
 {
 	int16_t magCount[3] = { 0, 0, 0 };    // Stores the 16-bit signed magnetometer sensor output
 	readMagData(magCount);  // Read the x/y/z adc values
+	convertMag(magCount);
+}
+#pragma endregion
+
+#pragma region void MPU9250::updateMaster()
+/* Update all sensor data with one burst read
+Input: /
+Output: /
+Description:
+	* Read accelometer, temperature and gyro registers followed by EXT_SENS_DATA, where the internal I2C master stores
+	  magnetometer ST1, data and ST2 - MASTER_FRAME bytes in one I2C transaction
+	* Keep previous values on read error
+	* Use magnetometer data only if it is new and there was no magnetic sensor overflow
+*/
+void MPU9250::updateMaster()
+{
+	uint8_t rawData[MASTER_FRAME];
+	readBytes(MPU9250_ADDRESS, ACCEL_XOUT_H, MASTER_FRAME, &rawData[0]); // INT cleared on any read
+	if (i2c_err_ && i2c_err_ != 7) {
+		return;
+	}
+	parseMaster(rawData);
+}
+#pragma endregion
+
+#pragma region void MPU9250::parseMaster(uint8_t * rawData)
+/* Convert master read frame
+Input: uint8_t[MASTER_FRAME] raw data from ACCEL_XOUT_H to the end of EXT_SENS_DATA, IMU_FRAME bytes in six-axis mode
+Output: /
+Description: use magnetometer data only if it is new and there was no magnetic sensor overflow
+*/
+void MPU9250::parseMaster(uint8_t * rawData)
+{
+	int16_t MPU9250Data[7]; // big endian
+	for (int i = 0; i < 7; i++) {
+		MPU9250Data[i] = ((int16_t)rawData[2 * i] << 8) | rawData[2 * i + 1];
+	}
+	convertAccelGyro(MPU9250Data);
+
+	if (!imu && (rawData[14] & 0x01) && !(rawData[21] & 0x08)) { // New data in ST1 and no overflow in ST2
+		int16_t magCount[3]; // little endian
+		for (int i = 0; i < 3; i++) {
+			magCount[i] = ((int16_t)rawData[16 + 2 * i] << 8) | rawData[15 + 2 * i];
+		}
+		convertMag(magCount);
+	}
+}
+#pragma endregion
+
+#pragma region bool MPU9250::updateAsync()
+/* Update all sensor data with non-blocking reads
+Input: /
+Output: bool - was new data read?
+Description:
+	* Process I2C queue - finished read calls asyncDone()
+	* Finished read is used if it was read without error and INT_STATUS shows new data
+	* When no read is in progress, queue a read of INT_STATUS and the master read frame - MASTER_FRAME + 1 bytes,
+	  IMU_FRAME + 1 in six-axis mode.
+	  In interrupt mode only after a data-ready interrupt, otherwise it also polls data-ready.
+*/
+bool MPU9250::updateAsync()
+{
+	i2c.Poll();
+
+	bool updated = false;
+	if (async_state == ASYNC_DONE) {
+		async_state = ASYNC_IDLE;
+		i2c_err_ = async_status;
+		if (i2c_err_ && i2c_err_ != 7) {
+			pirntI2CError();
+		}
+		else if (async_frame[0] & 0x01) { // Data ready
+			parseMaster(&async_frame[1]);
+			updated = true;
+		}
+	}
+
+	if (async_state == ASYNC_IDLE) {
+		uint32_t t = micros();
+		if (interrupt) {
+			if (!queue.Pop(&t)) {
+				return updated;
+			}
+			while (queue.Pop(&t));
+		}
+		int n = imu ? IMU_FRAME + 1 : MASTER_FRAME + 1;
+		if (i2c.Read(MPU9250_ADDRESS, INT_STATUS, async_frame, n, MPU9250::asyncDone, this)) {
+			async_state = ASYNC_PENDING;
+			async_time = t;
+			i2c.Poll(); // Start transfer
+		}
+	}
+	return updated;
+}
+#pragma endregion
+
+#pragma region void MPU9250::asyncDone(void * context, uint8_t status)
+/* Non-blocking read finished
+Input: void * context - MPU9250 instance, uint8_t status - I2C status
+Output: /
+Description: called from I2CQueue::Poll() in the main loop
+*/
+void MPU9250::asyncDone(void * context, uint8_t status)
+{
+	MPU9250 *mpu = (MPU9250 *)context;
+	mpu->async_status = status;
+	mpu->async_state = ASYNC_DONE;
+}
+#pragma endregion
 
+#pragma region void MPU9250::convertMag(int16_t * magCount)
+/* Convert magnetometer data
+Input: int16_t[3] raw magnetometer data
+Output: /
+Description:
+	* Add the uncalibrated field to the streaming calibration, update bias and scale when its fit is accepted
+	* Convert raw data to scaled magnetometer readings
+*/
+void MPU9250::convertMag(int16_t * magCount)
+{
 							// Calculate the magnetometer values in milliGauss
 							// Include factory calibration per data sheet and user environmental corrections
-	m[0] = (float)(magCount[0] * mRes * magCalibration[0] - magBias[0]) * magScale[0];  // get actual magnetometer value, this depends on scale being set
-	m[1] = (float)(magCount[1] * mRes * magCalibration[1] - magBias[1]) * magScale[1];
-	m[2] = (float)(magCount[2] * mRes * magCalibration[2] - magBias[2]) * magScale[2];
+	float raw[3];
+	for (int i = 0; i < 3; i++) {
+		raw[i] = (float)magCount[i] * mRes * magCalibration[i];
+	}
+	if (mag_calibration && mag_cal.AddSample(raw[0], raw[1], raw[2])) {
+		if (mag_cal.Solve(magBias, magScale)) {
+			LOG(3, "Mag calibration: bias %d %d %d mG", (int)magBias[0], (int)magBias[1], (int)magBias[2]);
+		}
+	}
+	m[0] = (raw[0] - magBias[0]) * magScale[0];  // get actual magnetometer value, this depends on scale being set
+	m[1] = (raw[1] - magBias[1]) * magScale[1];
+	m[2] = (raw[2] - magBias[2]) * magScale[2];
+}
+#pragma endregion
+
+#pragma region bool MPU9250::updateFifo()
+/* Update data in FIFO mode
+Input: /
+Output: bool - was the update done?
+Description:
+	* When all drained samples were used, wait for the drain period and drain the FIFO
+	* Convert next sample and update quaternions with the fixed sample time
+	* Time of samples lost on FIFO overflow or read error is added to the time interval of the next output
+*/
+bool MPU9250::updateFifo()
+{
+	if (fifo_pos >= fifo_frames) {
+		if (millis() - last_drain < FIFO_DRAIN_PERIOD) {
+			return false;
+		}
+		drainFifo();
+		if (fifo_frames == 0) {
+			return false;
+		}
+	}
+
+	uint8_t *frame = &fifo_buffer[fifo_frame * fifo_pos++];
+	int16_t MPU9250Data[7]; // acceleration, temperature and gyro, big endian in the FIFO
+	for (int i = 0; i < 3; i++) {
+		MPU9250Data[i] = ((int16_t)frame[2 * i] << 8) | frame[2 * i + 1];
+		MPU9250Data[i + 4] = ((int16_t)frame[6 + 2 * i] << 8) | frame[7 + 2 * i];
+	}
+	MPU9250Data[3] = 0;
+	convertAccelGyro(MPU9250Data);
+
+	if (!imu && !(frame[18] & 0x08)) { // Check if magnetic sensor overflow set in ST2, if not then use data
+		int16_t magCount[3]; // little endian
+		for (int i = 0; i < 3; i++) {
+			magCount[i] = ((int16_t)frame[13 + 2 * i] << 8) | frame[12 + 2 * i];
+		}
+		convertMag(magCount);
+	}
+
+	deltat = fifo_dt;
+	MadgwickQuaternionUpdate(a[0], a[1], a[2], g[0]*PI / 180.0f, g[1] *PI / 180.0f, g[2] *PI / 180.0f, m[1], m[0], m[2]);
+
+	rotateAcc();
+	sum_send = fifo_dt + fifo_gap;
+	fifo_gap = 0.0f;
+	return true;
+}
+#pragma endregion
+
+#pragma region int16_t MPU9250::getVerticalAcc()
+/* Get vertical rotated acceleration
+Input: /
+Output: int16_t - earth frame vertical acceleration in mg with gravity subtracted
+*/
+int16_t MPU9250::getVerticalAcc() {
+
+	return((int16_t)(1000 * acc_vertical - 1000));
+}
+#pragma endregion
+
+#pragma region VectorFloat MPU9250::getEarthAcc()
+/* Get rotated acceleration vector
+Input: /
+Output: VectorFloat - earth frame acceleration in g - x magnetic north, y west, z up
+Description: only valid with full rotation enabled, otherwise holds the last fully rotated sample
+*/
+VectorFloat MPU9250::getEarthAcc() {
+
+	return Acc;
+}
+#pragma endregion
+
+#pragma region int16_t MPU9250::getEastAcc()
+/* Get east rotated acceleration
+Input: /
+Output: int16_t - acceleration towards true east in mg
+Description: earth frame of the quaternion is x magnetic north, y west, z up - rotate it by magnetic declination
+*/
+int16_t MPU9250::getEastAcc() {
+
+	return((int16_t)(1000 * (Acc.x * declination_sin - Acc.y * declination_cos)));
+}
+#pragma endregion
+
+#pragma region int16_t MPU9250::getNorthAcc()
+/* Get north rotated acceleration
+Input: /
+Output: int16_t - acceleration towards true north in mg
+*/
+int16_t MPU9250::getNorthAcc() {
+
+	return((int16_t)(1000 * (Acc.x * declination_cos + Acc.y * declination_sin)));
+}
+#pragma endregion
+
+#pragma region void MPU9250::setFifo(bool enable)
+/* Enable or disable FIFO acquisition
+Input: bool enable
+Output: /
+Description: samples are buffered in the MPU9250 FIFO and drained every FIFO_DRAIN_PERIOD millis, the MCU can sleep
+             for getIdleTime() in between. Setting is kept and applied again in setup().
+*/
+void MPU9250::setFifo(bool enable)
+{
+	fifo = enable;
+	if (fifo) {
+		interrupt = false;
+		async = false;
+		initFifo();
+	}
+	else {
+		writeByte(MPU9250_ADDRESS, FIFO_EN, 0x00);
+		writeByte(MPU9250_ADDRESS, USER_CTRL, 0x00); // Disable FIFO and I2C master
+		initMPU9250();
+		if (master_read && !imu) {
+			initMaster(AK8963_ST1, 8);
+		}
+	}
+}
+#pragma endregion
+
+#pragma region void MPU9250::setInterrupt(bool enable)
+/* Enable or disable data-ready interrupt acquisition
+Input: bool enable
+Output: /
+Description: INT pin pulses on each new sample and its ISR must call dataReady(). INT_STATUS is no longer polled and the
+             MCU can sleep for getIdleTime() between samples. Not used in FIFO mode.
+*/
+void MPU9250::setInterrupt(bool enable)
+{
+	interrupt = enable && !fifo;
+	queue.Flush();
+}
+#pragma endregion
+
+#pragma region void MPU9250::setMasterRead(bool enable)
+/* Enable or disable master read mode
+Input: bool enable
+Output: /
+Description: internal I2C master reads magnetometer ST1, data and ST2 into EXT_SENS_DATA at every sample, so one
+             MASTER_FRAME byte burst returns all nine axes instead of up to four transactions in bypass mode.
+             FIFO mode always uses the I2C master. Setting is kept and applied again in setup().
+*/
+void MPU9250::setMasterRead(bool enable)
+{
+	master_read = enable;
+	if (fifo || imu) {
+		return;
+	}
+	if (master_read) {
+		initMaster(AK8963_ST1, 8);
+	}
+	else {
+		writeByte(MPU9250_ADDRESS, I2C_SLV0_CTRL, 0x00); // Disable slave 0
+		writeByte(MPU9250_ADDRESS, USER_CTRL, 0x00); // Disable I2C master
+		initMPU9250();
+	}
+}
+#pragma endregion
+
+#pragma region void MPU9250::setAsync(bool enable)
+/* Enable or disable non-blocking sample reads
+Input: bool enable
+Output: /
+Description: each sample is read with one queued I2C transaction that moves in the background while the main loop
+             computes. Enables master read mode, so one burst holds all nine axes. Not used in FIFO mode.
+*/
+void MPU9250::setAsync(bool enable)
+{
+	async = enable && !fifo;
+	if (async && !master_read) {
+		setMasterRead(true);
+	}
+	i2c.Init();
+	async_state = ASYNC_IDLE;
+}
+#pragma endregion
+
+#pragma region void MPU9250::setFullRotation(bool enable)
+/* Enable full rotation
+Input: bool enable - rotate all three axes into the earth frame, false rotates only the vertical one
+Output: /
+Description: east and north accelerations are only needed for directional analysis
+*/
+void MPU9250::setFullRotation(bool enable) {
+	full_rotation = enable;
+}
+#pragma endregion
+
+#pragma region void MPU9250::setIMU(bool enable)
+/* Enable or disable six-axis fusion
+Input: bool enable
+Output: /
+Description:
+	* Gravity direction is all the vertical acceleration needs - in six-axis mode the magnetometer is powered down,
+	  not read and not calibrated, and the Madgwick step has no magnetic field terms. Heading drifts with the gyro,
+	  so east and north accelerations are not valid for directional analysis.
+	* Stop the I2C master and re-initialise with bypass, so the magnetometer can be powered down or up
+	* Apply FIFO or master read mode again. Setting is kept and applied again in setup().
+*/
+void MPU9250::setIMU(bool enable)
+{
+	imu = enable;
+	writeByte(MPU9250_ADDRESS, FIFO_EN, 0x00);
+	writeByte(MPU9250_ADDRESS, I2C_SLV0_CTRL, 0x00); // Disable slave 0
+	writeByte(MPU9250_ADDRESS, USER_CTRL, 0x00); // Disable FIFO and I2C master
+	initMPU9250();
+	if (imu) {
+		writeByte(AK8963_ADDRESS, AK8963_CNTL, 0x00); // Power down magnetometer
+	}
+	else {
+		initAK8963(magCalibration);
+	}
+
+	if (fifo) {
+		initFifo();
+	}
+	else if (master_read && !imu) {
+		initMaster(AK8963_ST1, 8);
+	}
+	i2c.Init();
+	async_state = ASYNC_IDLE;
+}
+#pragma endregion
+
+#pragma region void MPU9250::setBiasEstimation(bool enable)
+/* Enable or disable online bias estimation
+Input: bool enable
+Output: /
+Description: once the filter has converged, gyro bias is tracked with the Madgwick drift gain zeta and accelometer
+             offset is refined from the long-term gravity magnitude. Estimates are kept in EEPROM over power cycles.
+*/
+void MPU9250::setBiasEstimation(bool enable)
+{
+	bias_estimation = enable;
+}
+#pragma endregion
+
+#pragma region void MPU9250::setMagCalibration(bool enable)
+/* Enable or disable streaming magnetometer calibration
+Input: bool enable
+Output: /
+Description: hard- and soft-iron are fitted to the samples of normal operation. magBias and magScale are updated when
+             the samples cover enough orientations for a well conditioned fit, they are kept in EEPROM with the biases.
+*/
+void MPU9250::setMagCalibration(bool enable)
+{
+	mag_calibration = enable;
+}
+#pragma endregion
+
+#pragma region void MPU9250::dataReady()
+/* Data-ready interrupt handler
+Input: /
+Output: /
+Description: queue time of the new sample, the sensor is read later by update()
+*/
+void MPU9250::dataReady()
+{
+	if (interrupt) {
+		queue.Push(micros());
+	}
 }
 #pragma endregion
 
-int16_t MPU9250::getZacc() {
+unsigned long MPU9250::getIdleTime() {
 
-	return((int16_t)(1000 * Acc.z - 1000));
+	if (async && async_state != ASYNC_IDLE) {
+		return 0; // Transfer in progress
+	}
+	if (interrupt) {
+		return (queue.Available() > 0) ? 0 : INT_IDLE_TIMEOUT;
+	}
+	if (!fifo || fifo_pos < fifo_frames) {
+		return 0;
+	}
+	unsigned long elapsed = millis() - last_drain;
+	return (elapsed < FIFO_DRAIN_PERIOD) ? FIFO_DRAIN_PERIOD - elapsed : 0;
 }
 
 float MPU9250::getDt() {
@@ -227,8 +720,51 @@ float MPU9250::getDt() {
 	return(sum_send);
 }
 
+bool MPU9250::isClipped() {
+
+	return(sample_clipped);
+}
+
+bool MPU9250::isValid() {
+
+	return(sample_valid);
+}
+
+bool MPU9250::isWarm() {
+
+	return(warm);
+}
+
+bool MPU9250::isConverged() {
+
+	return(converged);
+}
+
+#pragma region float MPU9250::getTiltError()
+/* Get tilt error
+Input: /
+Output: float - angle between measured acceleration and gravity direction of the quaternion in degrees
+Description: small when the quaternion has converged and the sensor is not accelerating much
+*/
+float MPU9250::getTiltError() {
+
+	float norm = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+	if (norm == 0.0f) {
+		return 180.0f;
+	}
+	float gx = 2.0f * (Q.x * Q.z - Q.w * Q.y); // Gravity direction in sensor frame
+	float gy = 2.0f * (Q.w * Q.x + Q.y * Q.z);
+	float gz = Q.w * Q.w - Q.x * Q.x - Q.y * Q.y + Q.z * Q.z;
+	float c = (a[0] * gx + a[1] * gy + a[2] * gz) / norm;
+	c = constrain(c, -1.0f, 1.0f);
+	return acosf(c) * 180.0f / PI;
+}
+#pragma endregion
+
 void MPU9250::MPU9250sleep() {
 
+	saveState();
+
 	writeByte(MPU9250_ADDRESS, PWR_MGMT_1, 0x3f); // Set sleep mode bit (6), disable all sensors
 	delay(100);
 	writeByte(MPU9250_ADDRESS, PWR_MGMT_1, 0x48); // Set sleep mode bit (6), disable all sensors
@@ -240,6 +776,344 @@ void MPU9250::MPU9250sleep() {
 
 /* PRIVATE METHODS */
 
+#pragma region void MPU9250::updateConvergence(float residual, float rate, float gravity)
+/* Update convergence monitors
+Input: float residual - magnitude of the gradient step before normalisation, float rate - quaternion rate of change
+       not explained by the gyro, float gravity - acceleration magnitude in g
+Output: /
+Description:
+	* Average each monitor exponentially with CONVERGENCE_TAU time constant
+	* Filter is converged when all monitors stay below their thresholds for CONVERGENCE_HOLD millis. Once converged it
+	  stays converged until the next setup, so waves do not interrupt the record.
+	* Until converged anneal beta from the warm-up value down to the nominal one with BETA_TAU time constant
+*/
+void MPU9250::updateConvergence(float residual, float rate, float gravity)
+{
+	if (converged || deltat <= 0.0f) {
+		return;
+	}
+	float w = min(1.0f, deltat / CONVERGENCE_TAU);
+	conv_residual += (residual - conv_residual) * w;
+	conv_rate += (rate - conv_rate) * w;
+	conv_gravity += (fabsf(gravity - 1.0f) - conv_gravity) * w;
+
+	if (conv_residual < CONVERGENCE_RESIDUAL && conv_rate < CONVERGENCE_RATE && conv_gravity < CONVERGENCE_GRAVITY) {
+		conv_time += deltat;
+	}
+	else {
+		conv_time = 0.0f;
+	}
+
+	beta = beta_nominal + (beta - beta_nominal) * (1.0f - min(1.0f, deltat / BETA_TAU));
+	if (conv_time * 1000.0f >= CONVERGENCE_HOLD) {
+		converged = true;
+		beta = beta_nominal;
+		LOG(1, "AHRS converged, residual %d, rate %d", (int)(conv_residual * 1000), (int)(conv_rate * 1000));
+	}
+}
+#pragma endregion
+
+#pragma region void MPU9250::saveState()
+/* Save filter state
+Input: /
+Output: /
+Description: keep converged quaternion and integral error with the time of save. RAM is retained in STOP mode, so
+             the state survives sleep between measurements, but not a reset. Bias estimates are written to EEPROM.
+*/
+void MPU9250::saveState()
+{
+	saveBias();
+	Q_saved = Q;
+	for (int i = 0; i < 3; i++) {
+		eInt_saved[i] = eInt[i];
+	}
+	ahrs_saved_time = millis();
+	ahrs_saved = true;
+}
+#pragma endregion
+
+#pragma region void MPU9250::restoreState()
+/* Restore filter state
+Input: /
+Output: /
+Description:
+	* Warm start - state saved less than WARM_START_MAX_AGE millis ago is restored, the filter only has to follow the
+	  motion during sleep
+	* Cold start - filter starts from identity quaternion
+	* Gyro bias is kept in RAM in both cases
+	* Reset convergence monitors, cold start begins with warm-up beta
+*/
+void MPU9250::restoreState()
+{
+	warm = ahrs_saved && (millis() - ahrs_saved_time < WARM_START_MAX_AGE);
+	if (warm) {
+		Q = Q_saved;
+		for (int i = 0; i < 3; i++) {
+			eInt[i] = eInt_saved[i];
+		}
+		LOG(1, "AHRS warm start after %d s", (int)((millis() - ahrs_saved_time) / 1000));
+	}
+	else {
+		Q = Quaternion();
+		for (int i = 0; i < 3; i++) {
+			eInt[i] = 0.0f;
+		}
+	}
+	ahrs_saved = false;
+
+	beta = warm ? beta_nominal : BETA_WARMUP; // High gain speeds up convergence from identity
+	conv_residual = 1.0f;
+	conv_rate = 1.0f;
+	conv_gravity = 1.0f;
+	conv_time = 0.0f;
+	converged = false;
+}
+#pragma endregion
+
+#pragma region void MPU9250::updateBias(float * drift, float ax, float ay, float az)
+/* Update bias estimates
+Input: float[3] drift - gyro bias change of the last update in rad/s, float ax, float ay, float az - acceleration in g
+Output: /
+Description:
+	* Add gyro drift estimated by the Madgwick update to the gyro bias, so it is removed from the next samples
+	* Long-term magnitude of acceleration is 1 g - move the accelometer offset along the measured direction by the
+	  magnitude error with time constant ACCEL_BIAS_TAU. Wave accelerations average out, samples at full scale are
+	  skipped.
+	* Limit both biases to plausible values
+*/
+void MPU9250::updateBias(float * drift, float ax, float ay, float az)
+{
+	for (int i = 0; i < 3; i++) {
+		gyroBias[i] = constrain(gyroBias[i] + drift[i] * 180.0f / PI, -GYRO_BIAS_MAX, GYRO_BIAS_MAX);
+	}
+
+	float norm = sqrtf(ax * ax + ay * ay + az * az);
+	if (clipped || norm == 0.0f) {
+		return;
+	}
+	float k = min(1.0f, deltat / ACCEL_BIAS_TAU) * (norm - 1.0f) / norm;
+	accelBias[0] = constrain(accelBias[0] + k * ax, -ACCEL_BIAS_MAX, ACCEL_BIAS_MAX);
+	accelBias[1] = constrain(accelBias[1] + k * ay, -ACCEL_BIAS_MAX, ACCEL_BIAS_MAX);
+	accelBias[2] = constrain(accelBias[2] + k * az, -ACCEL_BIAS_MAX, ACCEL_BIAS_MAX);
+}
+#pragma endregion
+
+#pragma region void MPU9250::loadBias()
+/* Read bias estimates
+Input: /
+Output: /
+Description: once after power up read the bias and magnetometer calibration record from EEPROM. Without a valid record the pre-determined biases
+             are used. EEPROM is only available on STM32L0.
+*/
+void MPU9250::loadBias()
+{
+	if (bias_loaded) {
+		return;
+	}
+	bias_loaded = true;
+	for (int i = 0; i < 3; i++) {
+		gyroBias_saved[i] = gyroBias[i];
+		accelBias_saved[i] = accelBias[i];
+		magBias_saved[i] = magBias[i];
+		magScale_saved[i] = magScale[i];
+	}
+#ifdef ARDUINO_ARCH_STM32L0
+	uint32_t magic = 0;
+	EEPROM.get(BIAS_EEPROM_ADDRESS, magic);
+	if (magic != BIAS_EEPROM_MAGIC) {
+		LOG(1, "No saved biases");
+		return;
+	}
+	EEPROM.get(BIAS_EEPROM_ADDRESS + sizeof(magic), gyroBias_saved);
+	EEPROM.get(BIAS_EEPROM_ADDRESS + sizeof(magic) + sizeof(gyroBias_saved), accelBias_saved);
+	EEPROM.get(BIAS_EEPROM_ADDRESS + sizeof(magic) + 2 * sizeof(gyroBias_saved), magBias_saved);
+	EEPROM.get(BIAS_EEPROM_ADDRESS + sizeof(magic) + 3 * sizeof(gyroBias_saved), magScale_saved);
+	for (int i = 0; i < 3; i++) {
+		gyroBias[i] = constrain(gyroBias_saved[i], -GYRO_BIAS_MAX, GYRO_BIAS_MAX);
+		accelBias[i] = constrain(accelBias_saved[i], -ACCEL_BIAS_MAX, ACCEL_BIAS_MAX);
+		magBias[i] = magBias_saved[i];
+		magScale[i] = constrain(magScale_saved[i], 1.0f / MAG_CAL_MAX_SCALE, MAG_CAL_MAX_SCALE);
+	}
+	LOG(1, "Saved biases loaded");
+#endif
+}
+#pragma endregion
+
+#pragma region void MPU9250::saveBias()
+/* Write bias estimates
+Input: /
+Output: /
+Description: write biases and magnetometer calibration to EEPROM only if one changed by more than BIAS_SAVE_GYRO or BIAS_SAVE_ACCEL, EEPROM has
+             limited write cycles. The record is marked valid after its data is written.
+*/
+void MPU9250::saveBias()
+{
+	bool changed = false;
+	for (int i = 0; i < 3; i++) {
+		changed |= fabsf(gyroBias[i] - gyroBias_saved[i]) > BIAS_SAVE_GYRO;
+		changed |= fabsf(accelBias[i] - accelBias_saved[i]) > BIAS_SAVE_ACCEL;
+		changed |= fabsf(magBias[i] - magBias_saved[i]) > BIAS_SAVE_MAG;
+		changed |= fabsf(magScale[i] - magScale_saved[i]) > BIAS_SAVE_MAG_SCALE;
+	}
+	if (!changed) {
+		return;
+	}
+	for (int i = 0; i < 3; i++) {
+		gyroBias_saved[i] = gyroBias[i];
+		accelBias_saved[i] = accelBias[i];
+		magBias_saved[i] = magBias[i];
+		magScale_saved[i] = magScale[i];
+	}
+#ifdef ARDUINO_ARCH_STM32L0
+	uint32_t magic = BIAS_EEPROM_MAGIC;
+	EEPROM.put(BIAS_EEPROM_ADDRESS + sizeof(magic), gyroBias_saved);
+	EEPROM.put(BIAS_EEPROM_ADDRESS + sizeof(magic) + sizeof(gyroBias_saved), accelBias_saved);
+	EEPROM.put(BIAS_EEPROM_ADDRESS + sizeof(magic) + 2 * sizeof(gyroBias_saved), magBias_saved);
+	EEPROM.put(BIAS_EEPROM_ADDRESS + sizeof(magic) + 3 * sizeof(gyroBias_saved), magScale_saved);
+	EEPROM.put(BIAS_EEPROM_ADDRESS, magic);
+	LOG(1, "Biases saved");
+#endif
+}
+#pragma endregion
+
+#pragma region void MPU9250::rotateAcc()
+/* Rotate acceleration into earth frame
+Input: /
+Output: /
+Description:
+	* Rotate acceleration with the rotation matrix of the quaternion - only its last row without full rotation,
+	  the wave height needs just the vertical component
+	* Store sensor status of the output and reset it for the next one
+	* Roll, pitch and yaw are not used by the analysis and are not updated here - call updateRPY() when needed
+*/
+void MPU9250::rotateAcc()
+{
+	if (full_rotation) {
+		Acc = VectorFloat(a[0], a[1], a[2]);
+		Acc.rotate(&Q);
+		acc_vertical = Acc.z;
+		LOG(3, "%d, %d, %d, %d", sum, (int)(Acc.x * 1000), (int)(Acc.y * 1000), (int)(Acc.z * 1000));
+	}
+	else {
+		acc_vertical = VectorFloat(a[0], a[1], a[2]).getRotatedZ(&Q);
+		LOG(3, "%d, %d", sum, (int)(acc_vertical * 1000));
+	}
+
+	sample_clipped = clipped;
+	sample_valid = new_data;
+	clipped = false;
+	new_data = false;
+}
+#pragma endregion
+
+#pragma region void MPU9250::initFifo()
+/* Initialise FIFO acquisition
+Input: /
+Output: /
+Description:
+	* Lower sample rate, so that the FIFO holds more than one drain period
+	* Disable bypass and let the internal I2C master read magnetometer data and ST2 through slave 0
+	* Reset FIFO and store accelometer, gyro and slave 0 data in it - FIFO_FRAME bytes per sample
+	* In six-axis mode slave 0 is disabled and only accelometer and gyro are stored - FIFO_FRAME_IMU bytes per sample
+*/
+void MPU9250::initFifo()
+{
+	writeByte(MPU9250_ADDRESS, INT_ENABLE, 0x00); // Data ready interrupt is not used
+	writeByte(MPU9250_ADDRESS, FIFO_EN, 0x00); // Disable FIFO while configuring
+	writeByte(MPU9250_ADDRESS, SMPLRT_DIV, FIFO_RATE_DIV);
+	if (imu) {
+		writeByte(MPU9250_ADDRESS, I2C_SLV0_CTRL, 0x00); // Disable slave 0
+		fifo_frame = FIFO_FRAME_IMU;
+	}
+	else {
+		initMaster(AK8963_XOUT_L, 7); // Data and ST2
+		fifo_frame = FIFO_FRAME;
+	}
+
+	resetFifo();
+	writeByte(MPU9250_ADDRESS, FIFO_EN, imu ? 0x78 : 0x79); // Accelerometer, gyro and slave 0 data
+
+	fifo_dt = (1 + FIFO_RATE_DIV) / 1000.0f;
+	fifo_frames = 0;
+	fifo_pos = 0;
+	fifo_gap = 0.0f;
+	last_drain = millis();
+}
+#pragma endregion
+
+#pragma region void MPU9250::initMaster(uint8_t reg, uint8_t count)
+/* Let the internal I2C master read the magnetometer
+Input: uint8_t reg - first magnetometer register, uint8_t count - number of registers
+Output: /
+Description: disable bypass and read count magnetometer registers through slave 0 at every sample into EXT_SENS_DATA
+*/
+void MPU9250::initMaster(uint8_t reg, uint8_t count)
+{
+	writeByte(MPU9250_ADDRESS, INT_PIN_CFG, 0x10); // INT is 50 microsecond pulse and any read to clear, bypass disabled
+	writeByte(MPU9250_ADDRESS, I2C_MST_CTRL, 0x0D); // I2C master clock 400 kHz
+	writeByte(MPU9250_ADDRESS, USER_CTRL, 0x20); // Enable I2C master
+	writeByte(MPU9250_ADDRESS, I2C_SLV0_ADDR, AK8963_ADDRESS | 0x80); // Read from magnetometer
+	writeByte(MPU9250_ADDRESS, I2C_SLV0_REG, reg);
+	writeByte(MPU9250_ADDRESS, I2C_SLV0_CTRL, 0x80 | count); // Enable slave 0
+	delay(10);
+}
+#pragma endregion
+
+#pragma region void MPU9250::resetFifo()
+/* Reset FIFO
+Input: /
+Output: /
+Description: empty the FIFO, keep FIFO and I2C master enabled
+*/
+void MPU9250::resetFifo()
+{
+	writeByte(MPU9250_ADDRESS, USER_CTRL, 0x24); // Reset FIFO, keep I2C master
+	writeByte(MPU9250_ADDRESS, USER_CTRL, 0x60); // Enable FIFO and I2C master
+}
+#pragma endregion
+
+#pragma region void MPU9250::drainFifo()
+/* Drain FIFO
+Input: /
+Output: /
+Description:
+	* On FIFO overflow samples were lost - reset FIFO and add the time since the last drain to the next output
+	* Read FIFO count and read all whole frames in bursts of I2C_BURST bytes
+	* On read error discard the drained data and reset FIFO
+*/
+void MPU9250::drainFifo()
+{
+	uint32_t now = millis();
+	float elapsed = (now - last_drain) / 1000.0f;
+	last_drain = now;
+	fifo_frames = 0;
+	fifo_pos = 0;
+
+	if (readByte(MPU9250_ADDRESS, INT_STATUS) & 0x10) { // FIFO overflow
+		LOG(1, "FIFO overflow");
+		resetFifo();
+		fifo_gap += elapsed;
+		return;
+	}
+
+	uint8_t data[2];
+	readBytes(MPU9250_ADDRESS, FIFO_COUNTH, 2, &data[0]); // read FIFO byte count
+	uint16_t fifo_count = ((uint16_t)(data[0] & 0x1F) << 8) | data[1];
+	int frames = min(fifo_count / fifo_frame, FIFO_SIZE / fifo_frame);
+	int bytes = frames * fifo_frame;
+
+	for (int i = 0; i < bytes; i += I2C_BURST) {
+		readBytes(MPU9250_ADDRESS, FIFO_R_W, min(I2C_BURST, bytes - i), &fifo_buffer[i]);
+		if (i2c_err_ && i2c_err_ != 7) {
+			resetFifo();
+			fifo_gap += elapsed;
+			return;
+		}
+	}
+	fifo_frames = frames;
+}
+#pragma endregion
+
 #pragma region bool MPU9250::available()
 /* Check if new data is avaliable
 Input: /
@@ -636,66 +1510,6 @@ void MPU9250::calibrateMPU9250(float * dest1, float * dest2)
 }
 #pragma endregion
 
-#pragma region void MPU9250::magcalMPU9250(float * dest1, float * dest2)
-/* Calibrate magnetometer
-Input: dest1 - float[3] magnetometer bias values
-	   dest2 - float[3] magnetometer scale values
-Output: /
-Description: 
-	* Print calibration instruction to user
-	* Shot ca. 15 s of calibration data
-	* Record min and max magnetometer data for all coordinates
-	* Preform hard iron correction and store bias
-	* Preform soft iron correction, and store scale
-*/
-void MPU9250::magcalMPU9250(float * dest1, float * dest2)
-{
-	uint16_t ii = 0, sample_count = 0;
-	int32_t mag_bias[3] = { 0, 0, 0 }, mag_scale[3] = { 0, 0, 0 };
-	int16_t mag_max[3] = { -32767, -32767, -32767 }, mag_min[3] = { 32767, 32767, 32767 }, mag_temp[3] = { 0, 0, 0 };
-
-	LOG(0, "Mag Calibration: Wave device in a figure eight until done!");
-	delay(4000);
-
-	// shoot for ~fifteen seconds of mag data
-	if (Mmode == 0x02) sample_count = 128;  // at 8 Hz ODR, new mag data is available every 125 ms
-	if (Mmode == 0x06) sample_count = 1500;  // at 100 Hz ODR, new mag data is available every 10 ms
-	for (ii = 0; ii < sample_count; ii++) {
-		readMagData(mag_temp);  // Read the mag data   
-		for (int jj = 0; jj < 3; jj++) {
-			if (mag_temp[jj] > mag_max[jj]) mag_max[jj] = mag_temp[jj];
-			if (mag_temp[jj] < mag_min[jj]) mag_min[jj] = mag_temp[jj];
-		}
-		if (Mmode == 0x02) delay(135);  // at 8 Hz ODR, new mag data is available every 125 ms
-		if (Mmode == 0x06) delay(12);  // at 100 Hz ODR, new mag data is available every 10 ms
-	}
-
-	// Get hard iron correction
-	mag_bias[0] = (mag_max[0] + mag_min[0]) / 2;  // get average x mag bias in counts
-	mag_bias[1] = (mag_max[1] + mag_min[1]) / 2;  // get average y mag bias in counts
-	mag_bias[2] = (mag_max[2] + mag_min[2]) / 2;  // get average z mag bias in counts
-
-	dest1[0] = (float)mag_bias[0] * mRes*magCalibration[0];  // save mag biases in G for main program
-	dest1[1] = (float)mag_bias[1] * mRes*magCalibration[1];
-	dest1[2] = (float)mag_bias[2] * mRes*magCalibration[2];
-
-	// Get soft iron correction estimate
-	mag_scale[0] = (mag_max[0] - mag_min[0]) / 2;  // get average x axis max chord length in counts
-	mag_scale[1] = (mag_max[1] - mag_min[1]) / 2;  // get average y axis max chord length in counts
-	mag_scale[2] = (mag_max[2] - mag_min[2]) / 2;  // get average z axis max chord length in counts
-
-	float avg_rad = mag_scale[0] + mag_scale[1] + mag_scale[2];
-	avg_rad /= 3.0;
-
-	dest2[0] = avg_rad / ((float)mag_scale[0]);
-	dest2[1] = avg_rad / ((float)mag_scale[1]);
-	dest2[2] = avg_rad / ((float)mag_scale[2]);
-
-	LOG(3,"Mag Calibration done!");
-}
-
-#pragma endregion
-
 #pragma region void MPU9250::updateRPY()
 /* Updare Roll, Pitch and Yaw
 Input: /
@@ -835,98 +1649,59 @@ Input:
 * float my - y mag
 * float mz - z mag
 Output: /
-Description: update Quaternions.
+Description:
+	* Update quaternions with MadgwickUpdate from ahrs.h, in fixed point if AHRS_FIXED is defined
+	* In six-axis mode use MadgwickUpdateIMU, magnetometer data is ignored
+	* Until converged update convergence monitors, after it estimate gyro drift with zeta and refine biases
 */
 void MPU9250::MadgwickQuaternionUpdate(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz)
 {
-	float q1 = Q.w, q2 = Q.x, q3 = Q.y, q4 = Q.z;   // short name local variable for readability
-	float norm;
-	float hx, hy, _2bx, _2bz;
-	float s1, s2, s3, s4;
-	float qDot1, qDot2, qDot3, qDot4;
-
-	// Auxiliary variables to avoid repeated arithmetic
-	float _2q1mx;
-	float _2q1my;
-	float _2q1mz;
-	float _2q2mx;
-	float _4bx;
-	float _4bz;
-	float _2q1 = 2.0f * q1;
-	float _2q2 = 2.0f * q2;
-	float _2q3 = 2.0f * q3;
-	float _2q4 = 2.0f * q4;
-	float _2q1q3 = 2.0f * q1 * q3;
-	float _2q3q4 = 2.0f * q3 * q4;
-	float q1q1 = q1 * q1;
-	float q1q2 = q1 * q2;
-	float q1q3 = q1 * q3;
-	float q1q4 = q1 * q4;
-	float q2q2 = q2 * q2;
-	float q2q3 = q2 * q3;
-	float q2q4 = q2 * q4;
-	float q3q3 = q3 * q3;
-	float q3q4 = q3 * q4;
-	float q4q4 = q4 * q4;
-
-	// Normalise accelerometer measurement
-	norm = sqrtf(ax * ax + ay * ay + az * az);
-	if (norm == 0.0f) return; // handle NaN
-	norm = 1.0f / norm;
-	ax *= norm;
-	ay *= norm;
-	az *= norm;
-
-	// Normalise magnetometer measurement
-	norm = sqrtf(mx * mx + my * my + mz * mz);
-	if (norm == 0.0f) return; // handle NaN
-	norm = 1.0f / norm;
-	mx *= norm;
-	my *= norm;
-	mz *= norm;
-
-	// Reference direction of Earth's magnetic field
-	_2q1mx = 2.0f * q1 * mx;
-	_2q1my = 2.0f * q1 * my;
-	_2q1mz = 2.0f * q1 * mz;
-	_2q2mx = 2.0f * q2 * mx;
-	hx = mx * q1q1 - _2q1my * q4 + _2q1mz * q3 + mx * q2q2 + _2q2 * my * q3 + _2q2 * mz * q4 - mx * q3q3 - mx * q4q4;
-	hy = _2q1mx * q4 + my * q1q1 - _2q1mz * q2 + _2q2mx * q3 - my * q2q2 + my * q3q3 + _2q3 * mz * q4 - my * q4q4;
-	_2bx = sqrtf(hx * hx + hy * hy);
-	_2bz = -_2q1mx * q3 + _2q1my * q2 + mz * q1q1 + _2q2mx * q4 - mz * q2q2 + _2q3 * my * q4 - mz * q3q3 + mz * q4q4;
-	_4bx = 2.0f * _2bx;
-	_4bz = 2.0f * _2bz;
-
-	// Gradient decent algorithm corrective step
-	s1 = -_2q3 * (2.0f * q2q4 - _2q1q3 - ax) + _2q2 * (2.0f * q1q2 + _2q3q4 - ay) - _2bz * q3 * (_2bx * (0.5f - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (-_2bx * q4 + _2bz * q2) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + _2bx * q3 * (_2bx * (q1q3 + q2q4) + _2bz * (0.5f - q2q2 - q3q3) - mz);
-	s2 = _2q4 * (2.0f * q2q4 - _2q1q3 - ax) + _2q1 * (2.0f * q1q2 + _2q3q4 - ay) - 4.0f * q2 * (1.0f - 2.0f * q2q2 - 2.0f * q3q3 - az) + _2bz * q4 * (_2bx * (0.5f - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (_2bx * q3 + _2bz * q1) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + (_2bx * q4 - _4bz * q2) * (_2bx * (q1q3 + q2q4) + _2bz * (0.5f - q2q2 - q3q3) - mz);
-	s3 = -_2q1 * (2.0f * q2q4 - _2q1q3 - ax) + _2q4 * (2.0f * q1q2 + _2q3q4 - ay) - 4.0f * q3 * (1.0f - 2.0f * q2q2 - 2.0f * q3q3 - az) + (-_4bx * q3 - _2bz * q1) * (_2bx * (0.5f - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (_2bx * q2 + _2bz * q4) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + (_2bx * q1 - _4bz * q3) * (_2bx * (q1q3 + q2q4) + _2bz * (0.5f - q2q2 - q3q3) - mz);
-	s4 = _2q2 * (2.0f * q2q4 - _2q1q3 - ax) + _2q3 * (2.0f * q1q2 + _2q3q4 - ay) + (-_4bx * q4 + _2bz * q2) * (_2bx * (0.5f - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (-_2bx * q1 + _2bz * q3) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + _2bx * q2 * (_2bx * (q1q3 + q2q4) + _2bz * (0.5f - q2q2 - q3q3) - mz);
-	norm = sqrtf(s1 * s1 + s2 * s2 + s3 * s3 + s4 * s4);    // normalise step magnitude
-	norm = 1.0f / norm;
-	s1 *= norm;
-	s2 *= norm;
-	s3 *= norm;
-	s4 *= norm;
-
-	// Compute rate of change of quaternion
-	qDot1 = 0.5f * (-q2 * gx - q3 * gy - q4 * gz) - beta * s1;
-	qDot2 = 0.5f * (q1 * gx + q3 * gz - q4 * gy) - beta * s2;
-	qDot3 = 0.5f * (q1 * gy - q2 * gz + q4 * gx) - beta * s3;
-	qDot4 = 0.5f * (q1 * gz + q2 * gy - q3 * gx) - beta * s4;
-
-	// Integrate to yield quaternion
-	q1 += qDot1 * deltat;
-	q2 += qDot2 * deltat;
-	q3 += qDot3 * deltat;
-	q4 += qDot4 * deltat;
-	norm = sqrtf(q1 * q1 + q2 * q2 + q3 * q3 + q4 * q4);    // normalise quaternion
-	norm = 1.0f / norm;
-	Q.w = q1 * norm;
-	Q.x = q2 * norm;
-	Q.y = q3 * norm;
-	Q.z = q4 * norm;
-
+	Quaternion q_old = Q;
+	bool estimate = converged && bias_estimation;
+	float drift[3] = { 0.0f, 0.0f, 0.0f }; // gyro bias change in rad/s
+#ifdef AHRS_FIXED
+	QuaternionT<AHRSFixed> q(AHRSFixed(Q.w), AHRSFixed(Q.x), AHRSFixed(Q.y), AHRSFixed(Q.z));
+	AHRSFixed d[3];
+	AHRSFixed r;
+	if (imu) {
+		r = MadgwickUpdateIMU(q, AHRSFixed(ax), AHRSFixed(ay), AHRSFixed(az), AHRSFixed(gx), AHRSFixed(gy), AHRSFixed(gz),
+			AHRSFixed(beta), AHRSFixed(deltat), estimate ? d : 0, AHRSFixed(zeta));
+	}
+	else {
+		r = MadgwickUpdate(q, AHRSFixed(ax), AHRSFixed(ay), AHRSFixed(az), AHRSFixed(gx), AHRSFixed(gy), AHRSFixed(gz),
+			AHRSFixed(mx * AHRS_MAG_SCALE), AHRSFixed(my * AHRS_MAG_SCALE), AHRSFixed(mz * AHRS_MAG_SCALE), AHRSFixed(beta), AHRSFixed(deltat),
+			estimate ? d : 0, AHRSFixed(zeta));
+	}
+	float residual = r.toFloat();
+	if (residual == 0.0f) return; // zero measurement, quaternion not updated
+	Q = Quaternion(q.w.toFloat(), q.x.toFloat(), q.y.toFloat(), q.z.toFloat());
+	for (int i = 0; i < 3; i++) {
+		drift[i] = d[i].toFloat();
+	}
+#else
+	float residual = imu ? MadgwickUpdateIMU(Q, ax, ay, az, gx, gy, gz, beta, deltat, estimate ? drift : 0, zeta)
+		: MadgwickUpdate(Q, ax, ay, az, gx, gy, gz, mx, my, mz, beta, deltat, estimate ? drift : 0, zeta);
+	if (residual == 0.0f) return; // zero measurement, quaternion not updated
+#endif
+
+	if (converged) {
+		if (estimate) {
+			updateBias(drift, ax, ay, az);
+		}
+		return;
+	}
+	float gravity = sqrtf(ax * ax + ay * ay + az * az);
+
+	// Rate of change without the rotation measured by the gyro - correction of the gradient step
+	float rate = 0.0f;
+	if (deltat > 0.0f) {
+		float d1 = Q.w - q_old.w - 0.5f * (-q_old.x * gx - q_old.y * gy - q_old.z * gz) * deltat;
+		float d2 = Q.x - q_old.x - 0.5f * (q_old.w * gx + q_old.y * gz - q_old.z * gy) * deltat;
+		float d3 = Q.y - q_old.y - 0.5f * (q_old.w * gy - q_old.x * gz + q_old.z * gx) * deltat;
+		float d4 = Q.z - q_old.z - 0.5f * (q_old.w * gz + q_old.x * gy - q_old.y * gx) * deltat;
+		rate = sqrtf(d1 * d1 + d2 * d2 + d3 * d3 + d4 * d4) / deltat;
+	}
+	updateConvergence(residual, rate, gravity);
 }
 #pragma endregion
 
@@ -943,100 +1718,23 @@ Input:
 * float my - y mag
 * float mz - z mag
 Output: /
-Description: update Quaternions.
+Description: update Quaternions with MahonyUpdate from ahrs.h, in fixed point if AHRS_FIXED is defined
 */
 void MPU9250::MahonyQuaternionUpdate(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz)
 {
-	float q1 = Q.w, q2 = Q.x, q3 = Q.y, q4 = Q.z;   // short name local variable for readability
-	float norm;
-	float hx, hy, bx, bz;
-	float vx, vy, vz, wx, wy, wz;
-	float ex, ey, ez;
-	float pa, pb, pc;
-
-	// Auxiliary variables to avoid repeated arithmetic
-	float q1q1 = q1 * q1;
-	float q1q2 = q1 * q2;
-	float q1q3 = q1 * q3;
-	float q1q4 = q1 * q4;
-	float q2q2 = q2 * q2;
-	float q2q3 = q2 * q3;
-	float q2q4 = q2 * q4;
-	float q3q3 = q3 * q3;
-	float q3q4 = q3 * q4;
-	float q4q4 = q4 * q4;
-
-	// Normalise accelerometer measurement
-	norm = sqrtf(ax * ax + ay * ay + az * az);
-	if (norm == 0.0f) return; // handle NaN
-	norm = 1.0f / norm;        // use reciprocal for division
-	ax *= norm;
-	ay *= norm;
-	az *= norm;
-
-	// Normalise magnetometer measurement
-	norm = sqrtf(mx * mx + my * my + mz * mz);
-	if (norm == 0.0f) return; // handle NaN
-	norm = 1.0f / norm;        // use reciprocal for division
-	mx *= norm;
-	my *= norm;
-	mz *= norm;
-
-	// Reference direction of Earth's magnetic field
-	hx = 2.0f * mx * (0.5f - q3q3 - q4q4) + 2.0f * my * (q2q3 - q1q4) + 2.0f * mz * (q2q4 + q1q3);
-	hy = 2.0f * mx * (q2q3 + q1q4) + 2.0f * my * (0.5f - q2q2 - q4q4) + 2.0f * mz * (q3q4 - q1q2);
-	bx = sqrtf((hx * hx) + (hy * hy));
-	bz = 2.0f * mx * (q2q4 - q1q3) + 2.0f * my * (q3q4 + q1q2) + 2.0f * mz * (0.5f - q2q2 - q3q3);
-
-	// Estimated direction of gravity and magnetic field
-	vx = 2.0f * (q2q4 - q1q3);
-	vy = 2.0f * (q1q2 + q3q4);
-	vz = q1q1 - q2q2 - q3q3 + q4q4;
-	wx = 2.0f * bx * (0.5f - q3q3 - q4q4) + 2.0f * bz * (q2q4 - q1q3);
-	wy = 2.0f * bx * (q2q3 - q1q4) + 2.0f * bz * (q1q2 + q3q4);
-	wz = 2.0f * bx * (q1q3 + q2q4) + 2.0f * bz * (0.5f - q2q2 - q3q3);
-
-	// Error is cross product between estimated direction and measured direction of gravity
-	ex = (ay * vz - az * vy) + (my * wz - mz * wy);
-	ey = (az * vx - ax * vz) + (mz * wx - mx * wz);
-	ez = (ax * vy - ay * vx) + (mx * wy - my * wx);
-	if (Ki > 0.0f)
-	{
-		eInt[0] += ex;      // accumulate integral error
-		eInt[1] += ey;
-		eInt[2] += ez;
-	}
-	else
-	{
-		eInt[0] = 0.0f;     // prevent integral wind up
-		eInt[1] = 0.0f;
-		eInt[2] = 0.0f;
+#ifdef AHRS_FIXED
+	QuaternionT<AHRSFixed> q(AHRSFixed(Q.w), AHRSFixed(Q.x), AHRSFixed(Q.y), AHRSFixed(Q.z));
+	AHRSFixed e[3] = { AHRSFixed(eInt[0]), AHRSFixed(eInt[1]), AHRSFixed(eInt[2]) };
+	MahonyUpdate(q, AHRSFixed(ax), AHRSFixed(ay), AHRSFixed(az), AHRSFixed(gx), AHRSFixed(gy), AHRSFixed(gz),
+		AHRSFixed(mx * AHRS_MAG_SCALE), AHRSFixed(my * AHRS_MAG_SCALE), AHRSFixed(mz * AHRS_MAG_SCALE), e, AHRSFixed(Kp), AHRSFixed(Ki), AHRSFixed(deltat));
+	Q = Quaternion(q.w.toFloat(), q.x.toFloat(), q.y.toFloat(), q.z.toFloat());
+	for (int i = 0; i < 3; i++) {
+		eInt[i] = e[i].toFloat();
 	}
-
-	// Apply feedback terms
-	gx = gx + Kp * ex + Ki * eInt[0];
-	gy = gy + Kp * ey + Ki * eInt[1];
-	gz = gz + Kp * ez + Ki * eInt[2];
-
-	// Integrate rate of change of quaternion
-	pa = q2;
-	pb = q3;
-	pc = q4;
-	q1 = q1 + (-q2 * gx - q3 * gy - q4 * gz) * (0.5f * deltat);
-	q2 = pa + (q1 * gx + pb * gz - pc * gy) * (0.5f * deltat);
-	q3 = pb + (q1 * gy - pa * gz + pc * gx) * (0.5f * deltat);
-	q4 = pc + (q1 * gz + pa * gy - pb * gx) * (0.5f * deltat);
-
-	// Normalise quaternion
-	norm = sqrtf(q1 * q1 + q2 * q2 + q3 * q3 + q4 * q4);
-	norm = 1.0f / norm;
-	Q.w = q1 * norm;
-	Q.x = q2 * norm;
-	Q.y = q3 * norm;
-	Q.z = q4 * norm;
-
+#else
+	MahonyUpdate(Q, ax, ay, az, gx, gy, gz, mx, my, mz, eInt, (float)(Kp), (float)(Ki), deltat);
+#endif
 }
-
 #pragma endregion
 
 /* WIRE FUNCTIONS */
@@ -1093,7 +1791,7 @@ Input: uint8_t address - register adress
 	   uint8_t cont - number of bytes to read
 	   uint8_t * dest - uint8_t[count] array to store read data
 Output: /
-Description: read data from register. Report commuication errors.
+Description: read data from register. Report commuication errors, also incomplete read.
 */
 void MPU9250::readBytes(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * dest)
 {
@@ -1110,6 +1808,11 @@ void MPU9250::readBytes(uint8_t address, uint8_t subAddress, uint8_t count, uint
 	{
 		dest[i++] = Wire.read();
 	} // Put read results in the Rx buffer
+	if (i < count && !i2c_err_)
+	{
+		i2c_err_ = 4; // incomplete read reported as other error
+		pirntI2CError();
+	}
 }
 #pragma endregion
 
@@ -7,11 +7,52 @@
 #include "MPU9250RegisterMap.h" //Register file
 #include "array_structures.h" //Quaternion and vector classes
 #include "debug_print.h"
+#include "sample_queue.h" //Data-ready events
+#include "i2c_queue.h" //Non-blocking I2C transactions
+#include "wire_bus.h" //I2C bus of the queue
+#include "ahrs.h" //Madgwick and Mahony filter updates
+#include "mag_calibration.h" //Streaming magnetometer calibration
+#ifdef ARDUINO_ARCH_STM32L0
+#include <EEPROM.h> //Bias estimates kept over power cycles
+#endif
 #include <stdarg.h>
 
 #define Kp 2.0f * 5.0f // these are the free parameters in the Mahony filter and fusion scheme, Kp for proportional feedback, Ki for integral
 #define Ki 0.0f
+#define AHRS_FIXED //Sensor fusion in fixed point - comment out for float
 #define INNITIAL_DATA_DELAY 10
+#define WARM_START_MAX_AGE 600000 //Max sleep time in millis to restore the filter state
+
+#define BETA_WARMUP 2.5f //Madgwick gain at cold start, annealed down to the nominal beta
+#define BETA_TAU 3.0f //Time constant of beta annealing in s
+#define CONVERGENCE_TAU 1.0f //Time constant of convergence monitors in s
+#define CONVERGENCE_RESIDUAL 0.1f //Max gradient step residual
+#define CONVERGENCE_RATE 0.5f //Max quaternion rate of change in 1/s
+#define CONVERGENCE_GRAVITY 0.05f //Max deviation of acceleration magnitude from 1 g
+#define CONVERGENCE_HOLD 2000 //Millis all monitors must stay below thresholds
+
+#define ACCEL_BIAS_TAU 600.0f //Time constant of accelerometer offset refinement in s
+#define ACCEL_BIAS_MAX 0.1f //Max accelerometer offset in g
+#define GYRO_BIAS_MAX 10.0f //Max gyro bias in deg/s
+#define BIAS_EEPROM_ADDRESS 0 //EEPROM address of saved biases
+#define BIAS_EEPROM_MAGIC 0x42494154 //Marks a valid bias record
+#define BIAS_SAVE_GYRO 0.02f //Min change of gyro bias in deg/s to write it to EEPROM
+#define BIAS_SAVE_ACCEL 0.001f //Min change of accelerometer offset in g to write it to EEPROM
+#define BIAS_SAVE_MAG 5.0f //Min change of magnetometer bias in mG to write it to EEPROM
+#define BIAS_SAVE_MAG_SCALE 0.01f //Min change of magnetometer scale to write it to EEPROM
+
+#define FIFO_FRAME 19 //Bytes per FIFO sample - accelometer 6, gyro 6, magnetometer 6 and ST2 1
+#define FIFO_FRAME_IMU 12 //Bytes per FIFO sample in six-axis mode - accelometer 6, gyro 6
+#define FIFO_SIZE 512 //FIFO size in bytes
+#define FIFO_RATE_DIV 9 //Sample rate divider in FIFO mode - 100 Hz, FIFO holds 26 samples
+#define FIFO_DRAIN_PERIOD 200 //Time between FIFO drains in millis
+#define I2C_BURST 32 //Max bytes in one I2C read - Wire buffer
+#define MASTER_FRAME 22 //Bytes per burst in master read mode - accelometer, temperature, gyro 14, ST1, magnetometer and ST2 8
+#define IMU_FRAME 14 //Bytes per burst in six-axis mode - accelometer, temperature, gyro
+#define ASYNC_IDLE 0 //States of non-blocking read
+#define ASYNC_PENDING 1
+#define ASYNC_DONE 2
+#define INT_IDLE_TIMEOUT 10 //Max sleep in millis while waiting for the data-ready interrupt
 
 enum Ascale {AFS_2G = 0, AFS_4G, AFS_8G, AFS_16G };
 enum Gscale { GFS_250DPS = 0, GFS_500DPS, GFS_1000DPS, GFS_2000DPS };
@@ -28,18 +69,30 @@ class MPU9250
 
 	// Calibration
     float magCalibration[3] = {0, 0, 0}; // factory mag calibration
-    float magBias[3] = { 254.35, -148.14, -166.12 }; //Pre-determined
+    float magBias[3] = { 254.35, -148.14, -166.12 }; //Pre-determined, initial values of streaming calibration
     float magScale[3]  = { 1.03, 1.02, 0.95 }; // Bias corrections for gyro and accelerometer
-    float gyroBias[3] = { 0.77, 0.03, 0.09 }; // bias corrections 
-    float accelBias[3] = { -2.72 / 1000.0, 13.91 / 1000.0, 21.87 / 1000.0 }; // bias corrections
+    float gyroBias[3] = { 0.77, 0.03, 0.09 }; // bias corrections, initial values of online estimation
+    float accelBias[3] = { -2.72 / 1000.0, 13.91 / 1000.0, 21.87 / 1000.0 }; // bias corrections, initial values of online estimation
+	float gyroBias_saved[3] = { 0.0f, 0.0f, 0.0f }, accelBias_saved[3] = { 0.0f, 0.0f, 0.0f }; // biases in EEPROM
+	float magBias_saved[3] = { 0.0f, 0.0f, 0.0f }, magScale_saved[3] = { 1.0f, 1.0f, 1.0f };
+	MagCalibration mag_cal; // streaming hard- and soft-iron estimator
+	bool mag_calibration = true; // update magBias and magScale from the streaming fit
+	bool bias_estimation = true; // online bias estimation once the filter has converged
+	bool bias_loaded = false; // biases were read from EEPROM after power up
 
     int16_t tempCount;      // temperature raw count output
     float temperature;    // Stores the real internal chip temperature in degrees Celsius
     float SelfTest[6];    // holds results of gyro and accelerometer self test
 
 	float GyroMeasError = PI * (4.0f / 180.0f);   // gyroscope measurement error in rads/s (start at 40 deg/s)
-	float GyroMeasDrift = PI * (0.0f / 180.0f);   // gyroscope measurement drift in rad/s/s (start at 0.0 deg/s/s)
+	float GyroMeasDrift = PI * (0.1f / 180.0f);   // gyroscope measurement drift in rad/s/s (start at 0.1 deg/s/s)
 	float beta = sqrt(3.0f / 4.0f) * GyroMeasError;   // compute beta
+	float beta_nominal = sqrt(3.0f / 4.0f) * GyroMeasError; // beta after warm-up
+
+	// Convergence monitors - exponential averages
+	float conv_residual = 1.0f, conv_rate = 1.0f, conv_gravity = 1.0f;
+	float conv_time = 0.0f; // seconds all monitors are below thresholds
+	bool converged = false;
 	float zeta = sqrt(3.0f / 4.0f) * GyroMeasDrift;   // compute zeta, the other free parameter in the Madgwick scheme usually set to a small or zero value
 
 	float a[3] = { 0.0f, 0.0f, 0.0f }, g[3] = { 0.0f, 0.0f, 0.0f }, m[3] = { 0.0f, 0.0f, 0.0f }; // variables to hold latest sensor data values 
@@ -54,26 +107,76 @@ class MPU9250
 	uint32_t lastUpdate = 0, firstUpdate = 0; // used to calculate integration interval
 	uint32_t Now = 0;
 
+	bool clipped = false, sample_clipped = false; // acceleration at full scale since last output, and in last output
+	bool new_data = false, sample_valid = true; // accelerometer read without errors since last output, and for last output
+
+	bool imu = false; //Six-axis fusion, magnetometer powered down
+	bool fifo = false; //FIFO acquisition
+	int fifo_frame = FIFO_FRAME; //Bytes per FIFO sample
+	uint8_t fifo_buffer[FIFO_SIZE]; //Drained FIFO data
+	int fifo_frames = 0, fifo_pos = 0; //Number of drained samples and next sample
+	uint32_t last_drain = 0; //Time of last drain
+	float fifo_dt = 0.01f, fifo_gap = 0.0f; //Sample time in FIFO mode, time of lost samples
+
+	bool master_read = false; //Magnetometer read by the internal I2C master into EXT_SENS_DATA
+	bool interrupt = false; //Data-ready interrupt acquisition
+	SampleQueue queue; //Times of data-ready interrupts
+
+	bool async = false; //Non-blocking sample reads
+	WireBus wire_bus; //Wire as I2C bus of the queue
+	I2CQueue i2c{ &wire_bus }; //Non-blocking I2C transactions
+	uint8_t async_frame[MASTER_FRAME + 1]; //INT_STATUS followed by master read frame
+	uint8_t async_state = ASYNC_IDLE; //State of non-blocking read
+	uint8_t async_status = 0; //I2C status of the finished read
+	uint32_t async_time = 0; //Time of the sample in micros
+
+	bool ahrs_saved = false; //Filter state was saved before sleep
+	bool warm = false; //Filter state was restored in setup
+	uint32_t ahrs_saved_time = 0; //Time of save
+	Quaternion Q_saved; //Saved quaternion
+	float eInt_saved[3] = { 0.0f, 0.0f, 0.0f }; //Saved Mahony integral error
+
 	Quaternion Q; //Quaternion
-	VectorFloat Acc; //Acc vector
+	VectorFloat Acc; //Acc vector, earth frame with full rotation
+	float acc_vertical = 1.0f; //Earth frame vertical acceleration in g
+	bool full_rotation = false; //Rotate all three axes for directional analysis
 
     float magnetic_declination = 4.62; // Ljubljana
+    float declination_sin = 0.0f, declination_cos = 1.0f; // rotation from magnetic to true north
 
 public:
 
 	MPU9250(); //Constructor
 	void setup(); //Setup function
 	void calibrateAccelGyro(); //Public MPU9250 calibration function
-	void calibrateMag(); //Public magnetometer calibration function
+	void calibrateMag(); //Restart streaming magnetometer calibration
 	bool isConnectedMPU9250(); //Check if MPU9250 is connected
 	bool isConnectedAK8963(); //Check if AK8963 magnetometer is connected
 	bool update(); //Update data
 	void updateAccelGyro(); //Update accelometer and gyro data
 	void updateMag(); //Update magnetometer readings
 
-	int16_t getZacc(); //Get Z rotated acceleration
+	int16_t getVerticalAcc(); //Get vertical rotated acceleration without gravity
+	VectorFloat getEarthAcc(); //Get rotated acceleration vector, needs full rotation
+	int16_t getEastAcc(); //Get east rotated acceleration, needs full rotation
+	int16_t getNorthAcc(); //Get north rotated acceleration, needs full rotation
 	float getDt(); //Get Z rotated acceleration
+	bool isClipped(); //Was acceleration at full scale in the last output
+	bool isValid(); //Was the last output read without errors
+	bool isWarm(); //Was the filter state restored from before sleep
+	bool isConverged(); //Has the orientation filter settled
+	float getTiltError(); //Angle between measured and estimated gravity in degrees
 	void setDataDelay(int); //Re-set value of data delay
+	void setFifo(bool); //Enable FIFO acquisition
+	void setInterrupt(bool); //Enable data-ready interrupt acquisition
+	void setMasterRead(bool); //Enable single burst 9-axis reads through the internal I2C master
+	void setAsync(bool); //Enable non-blocking sample reads
+	void setFullRotation(bool); //Rotate all three axes instead of only the vertical one
+	void setIMU(bool); //Enable six-axis fusion without magnetometer
+	void setBiasEstimation(bool); //Enable online gyro and accelometer bias estimation
+	void setMagCalibration(bool); //Enable streaming magnetometer calibration
+	void dataReady(); //Data-ready interrupt handler - call from the INT pin ISR
+	unsigned long getIdleTime(); //Millis the MCU can sleep before new data
 
 	void MPU9250sleep(); //Go to sleep
 
@@ -94,9 +197,27 @@ private:
 	int16_t readTempData(); //read temperature data
 
 	void calibrateMPU9250(float * dest1, float * dest2); //Calibrate accelometer and gyro
-	void magcalMPU9250(float * dest1, float * dest2); //Calibrate magnetometer
 
 	void updateRPY(); //Update roll, pitch and yaw
+	void saveState(); //Save filter state before sleep
+	void restoreState(); //Restore filter state or start cold
+	void updateBias(float * drift, float ax, float ay, float az); //Update gyro and accelometer bias estimates
+	void loadBias(); //Read bias estimates from EEPROM
+	void saveBias(); //Write changed bias estimates to EEPROM
+	void updateConvergence(float residual, float rate, float gravity); //Update convergence monitors and anneal beta
+	void convertAccelGyro(int16_t * MPU9250Data); //Convert raw accelometer and gyro data
+	void convertMag(int16_t * magCount); //Convert raw magnetometer data
+	void rotateAcc(); //Rotate acceleration into earth frame
+
+	void initMaster(uint8_t reg, uint8_t count); //Let the internal I2C master read magnetometer registers
+	void updateMaster(); //Update all sensor data with one burst read
+	void parseMaster(uint8_t * rawData); //Convert master read frame
+	bool updateAsync(); //Update all sensor data with non-blocking reads
+	static void asyncDone(void * context, uint8_t status); //Non-blocking read finished
+	void initFifo(); //Initialise FIFO acquisition
+	void resetFifo(); //Reset FIFO
+	void drainFifo(); //Read all samples from FIFO
+	bool updateFifo(); //Update data from drained FIFO
 	void MPU9250SelfTest(float * destination); //Accelerometer and gyroscope self test; check calibration wrt factory settings
 
 	void writeByte(uint8_t address, uint8_t subAddress, uint8_t data); //Write byte to register
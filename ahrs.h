@@ -0,0 +1,378 @@
+/* AHRS functions - Madgwick and Mahony orientation filter updates used in the MPU9250.h library
+* Both updates are templated on the scalar type, so the same code runs in float or in fixed point (Fixed from
+* fixed_point.h) on cores without FPU. Constants are written as ints, which are exact and cheap for both types.
+* Normalisation uses InvSqrt, so there are no divisions. Inputs: acceleration and magnetic field in any unit, they are
+* normalised, gyro in rad/s, time interval in s.
+* AHRS_FRAC fractional bits of the fixed-point instantiation: Q7.24 keeps the gradient step terms (up to about 20)
+* and the gyro in range, while a per-sample increment of beta * deltat ~ 3e-4 still has thousands of LSB.
+*/
+
+#ifndef _AHRS_H_
+#define _AHRS_H_
+
+#include "array_structures.h" //Quaternion
+#include "fixed_point.h" //Fixed point scalar
+
+#define AHRS_FRAC 24 //Fractional bits of fixed-point AHRS
+#define AHRS_MAG_SCALE (1.0f / 1024.0f) //Scale magnetic field in mG into fixed-point range, it is normalised anyway
+
+typedef Fixed<AHRS_FRAC> AHRSFixed; //Fixed-point AHRS scalar
+
+#pragma region bool Normalize(T &x, T &y, T &z)
+/* Normalise vector
+Input: T &x, T &y, T &z - vector, normalised in place
+Output: bool - false for zero vector
+Description: in fixed point the vector is first shifted left, so its largest component is at least 0.5. Squares of
+             small components would otherwise lose most of their bits.
+*/
+template <typename T>
+bool Normalize(T &x, T &y, T &z)
+{
+	T norm = x * x + y * y + z * z;
+	if (norm == T(0)) return false; // handle NaN
+	norm = InvSqrt(norm);
+	x *= norm;
+	y *= norm;
+	z *= norm;
+	return true;
+}
+
+template <int F>
+bool Normalize(Fixed<F> &x, Fixed<F> &y, Fixed<F> &z)
+{
+	uint32_t m = (uint32_t)abs(x.v) | (uint32_t)abs(y.v) | (uint32_t)abs(z.v);
+	if (m == 0) return false;
+	int shift = __builtin_clz(m) - (31 - F) - 1; // largest component to [0.5, 1)
+	if (shift > 0) {
+		x.v <<= shift;
+		y.v <<= shift;
+		z.v <<= shift;
+	}
+	Fixed<F> norm = InvSqrt(x * x + y * y + z * z);
+	x *= norm;
+	y *= norm;
+	z *= norm;
+	return true;
+}
+#pragma endregion
+
+#pragma region T NormalizeStep(T &s1, T &s2, T &s3, T &s4)
+/* Normalise gradient step
+Input: T &s1, T &s2, T &s3, T &s4 - gradient step, normalised in place
+Output: T - magnitude of the step before normalisation
+Description: in fixed point the step is first shifted, so its largest component is in [0.5, 1). Near convergence the
+             step is small and 1 / |s| would otherwise saturate, and large steps would overflow the sum of squares.
+*/
+template <typename T>
+T NormalizeStep(T &s1, T &s2, T &s3, T &s4)
+{
+	T norm = s1 * s1 + s2 * s2 + s3 * s3 + s4 * s4;
+	T magnitude = Sqrt(norm);
+	norm = InvSqrt(norm);
+	s1 *= norm;
+	s2 *= norm;
+	s3 *= norm;
+	s4 *= norm;
+	return magnitude;
+}
+
+template <int F>
+Fixed<F> NormalizeStep(Fixed<F> &s1, Fixed<F> &s2, Fixed<F> &s3, Fixed<F> &s4)
+{
+	uint32_t m = (uint32_t)abs(s1.v) | (uint32_t)abs(s2.v) | (uint32_t)abs(s3.v) | (uint32_t)abs(s4.v);
+	if (m == 0) return Fixed<F>::raw(0);
+	int shift = __builtin_clz(m) - (31 - F) - 1; // largest component to [0.5, 1)
+	if (shift > 0) {
+		s1.v <<= shift;
+		s2.v <<= shift;
+		s3.v <<= shift;
+		s4.v <<= shift;
+	}
+	else {
+		s1.v >>= -shift;
+		s2.v >>= -shift;
+		s3.v >>= -shift;
+		s4.v >>= -shift;
+	}
+	Fixed<F> norm = s1 * s1 + s2 * s2 + s3 * s3 + s4 * s4;
+	Fixed<F> inv = InvSqrt(norm);
+	Fixed<F> magnitude = norm * inv;
+	magnitude.v = (shift > 0) ? magnitude.v >> shift : magnitude.v << -shift;
+	s1 *= inv;
+	s2 *= inv;
+	s3 *= inv;
+	s4 *= inv;
+	return magnitude;
+}
+#pragma endregion
+
+#pragma region void CompensateDrift(T q1, T q2, T q3, T q4, T s1, T s2, T s3, T s4, T &gx, T &gy, T &gz, T *bias, T zeta, T deltat)
+/* Gyro bias drift compensation
+Input: T q1 - T q4 - quaternion, T s1 - T s4 - normalised gradient step, T &gx, T &gy, T &gz - gyro, corrected in place,
+       T *bias - T[3] estimated gyro bias in rad/s, updated in place, T zeta - drift gain, T deltat - time interval
+Output: /
+Description: angular rate of the gradient step in sensor frame, 2 q* s, is the direction of the gyro error. Its integral
+             scaled by zeta is the gyro bias, which is removed from the gyro rate.
+*/
+template <typename T>
+void CompensateDrift(T q1, T q2, T q3, T q4, T s1, T s2, T s3, T s4, T &gx, T &gy, T &gz, T *bias, T zeta, T deltat)
+{
+	T ex = 2 * (q1 * s2 - q2 * s1 - q3 * s4 + q4 * s3);
+	T ey = 2 * (q1 * s3 + q2 * s4 - q3 * s1 - q4 * s2);
+	T ez = 2 * (q1 * s4 - q2 * s3 + q3 * s2 - q4 * s1);
+	bias[0] += ex * zeta * deltat;
+	bias[1] += ey * zeta * deltat;
+	bias[2] += ez * zeta * deltat;
+	gx -= bias[0];
+	gy -= bias[1];
+	gz -= bias[2];
+}
+#pragma endregion
+
+#pragma region T MadgwickUpdate(QuaternionT<T> &q, T ax, T ay, T az, T gx, T gy, T gz, T mx, T my, T mz, T beta, T deltat, T *bias, T zeta)
+/* Madgwick Quaternion Update
+Input: QuaternionT<T> &q - quaternion, updated in place, acceleration, gyro and magnetic field, T beta - filter gain,
+       T deltat - time interval, T *bias - T[3] gyro bias estimate updated with CompensateDrift, 0 disables it,
+       T zeta - drift gain
+Output: T - magnitude of the gradient step before normalisation, 0 if a measurement was zero
+Description: gradient descent step towards measured gravity and magnetic field, fused with integrated gyro rate
+*/
+template <typename T>
+T MadgwickUpdate(QuaternionT<T> &q, T ax, T ay, T az, T gx, T gy, T gz, T mx, T my, T mz, T beta, T deltat, T *bias = 0, T zeta = T(0))
+{
+	T q1 = q.w, q2 = q.x, q3 = q.y, q4 = q.z;   // short name local variable for readability
+	T norm;
+	T hx, hy, _2bx, _2bz;
+	T s1, s2, s3, s4;
+	T qDot1, qDot2, qDot3, qDot4;
+
+	// Auxiliary variables to avoid repeated arithmetic
+	T _2q1mx;
+	T _2q1my;
+	T _2q1mz;
+	T _2q2mx;
+	T _4bx;
+	T _4bz;
+	T _2q1 = 2 * q1;
+	T _2q2 = 2 * q2;
+	T _2q3 = 2 * q3;
+	T _2q4 = 2 * q4;
+	T _2q1q3 = 2 * q1 * q3;
+	T _2q3q4 = 2 * q3 * q4;
+	T q1q1 = q1 * q1;
+	T q1q2 = q1 * q2;
+	T q1q3 = q1 * q3;
+	T q1q4 = q1 * q4;
+	T q2q2 = q2 * q2;
+	T q2q3 = q2 * q3;
+	T q2q4 = q2 * q4;
+	T q3q3 = q3 * q3;
+	T q3q4 = q3 * q4;
+	T q4q4 = q4 * q4;
+	T half = T(1) / 2;
+
+	// Normalise accelerometer and magnetometer measurement
+	if (!Normalize(ax, ay, az)) return T(0);
+	if (!Normalize(mx, my, mz)) return T(0);
+
+	// Reference direction of Earth's magnetic field
+	_2q1mx = 2 * q1 * mx;
+	_2q1my = 2 * q1 * my;
+	_2q1mz = 2 * q1 * mz;
+	_2q2mx = 2 * q2 * mx;
+	hx = mx * q1q1 - _2q1my * q4 + _2q1mz * q3 + mx * q2q2 + _2q2 * my * q3 + _2q2 * mz * q4 - mx * q3q3 - mx * q4q4;
+	hy = _2q1mx * q4 + my * q1q1 - _2q1mz * q2 + _2q2mx * q3 - my * q2q2 + my * q3q3 + _2q3 * mz * q4 - my * q4q4;
+	_2bx = Sqrt(hx * hx + hy * hy);
+	_2bz = -_2q1mx * q3 + _2q1my * q2 + mz * q1q1 + _2q2mx * q4 - mz * q2q2 + _2q3 * my * q4 - mz * q3q3 + mz * q4q4;
+	_4bx = 2 * _2bx;
+	_4bz = 2 * _2bz;
+
+	// Gradient decent algorithm corrective step
+	s1 = -_2q3 * (2 * q2q4 - _2q1q3 - ax) + _2q2 * (2 * q1q2 + _2q3q4 - ay) - _2bz * q3 * (_2bx * (half - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (-_2bx * q4 + _2bz * q2) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + _2bx * q3 * (_2bx * (q1q3 + q2q4) + _2bz * (half - q2q2 - q3q3) - mz);
+	s2 = _2q4 * (2 * q2q4 - _2q1q3 - ax) + _2q1 * (2 * q1q2 + _2q3q4 - ay) - 4 * q2 * (1 - 2 * q2q2 - 2 * q3q3 - az) + _2bz * q4 * (_2bx * (half - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (_2bx * q3 + _2bz * q1) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + (_2bx * q4 - _4bz * q2) * (_2bx * (q1q3 + q2q4) + _2bz * (half - q2q2 - q3q3) - mz);
+	s3 = -_2q1 * (2 * q2q4 - _2q1q3 - ax) + _2q4 * (2 * q1q2 + _2q3q4 - ay) - 4 * q3 * (1 - 2 * q2q2 - 2 * q3q3 - az) + (-_4bx * q3 - _2bz * q1) * (_2bx * (half - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (_2bx * q2 + _2bz * q4) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + (_2bx * q1 - _4bz * q3) * (_2bx * (q1q3 + q2q4) + _2bz * (half - q2q2 - q3q3) - mz);
+	s4 = _2q2 * (2 * q2q4 - _2q1q3 - ax) + _2q3 * (2 * q1q2 + _2q3q4 - ay) + (-_4bx * q4 + _2bz * q2) * (_2bx * (half - q3q3 - q4q4) + _2bz * (q2q4 - q1q3) - mx) + (-_2bx * q1 + _2bz * q3) * (_2bx * (q2q3 - q1q4) + _2bz * (q1q2 + q3q4) - my) + _2bx * q2 * (_2bx * (q1q3 + q2q4) + _2bz * (half - q2q2 - q3q3) - mz);
+	T residual = NormalizeStep(s1, s2, s3, s4);    // normalise step magnitude
+
+	if (bias) {
+		CompensateDrift(q1, q2, q3, q4, s1, s2, s3, s4, gx, gy, gz, bias, zeta, deltat);
+	}
+
+	// Compute rate of change of quaternion
+	qDot1 = (-q2 * gx - q3 * gy - q4 * gz) / 2 - beta * s1;
+	qDot2 = (q1 * gx + q3 * gz - q4 * gy) / 2 - beta * s2;
+	qDot3 = (q1 * gy - q2 * gz + q4 * gx) / 2 - beta * s3;
+	qDot4 = (q1 * gz + q2 * gy - q3 * gx) / 2 - beta * s4;
+
+	// Integrate to yield quaternion
+	q1 += qDot1 * deltat;
+	q2 += qDot2 * deltat;
+	q3 += qDot3 * deltat;
+	q4 += qDot4 * deltat;
+	norm = InvSqrt(q1 * q1 + q2 * q2 + q3 * q3 + q4 * q4);    // normalise quaternion
+	q.w = q1 * norm;
+	q.x = q2 * norm;
+	q.y = q3 * norm;
+	q.z = q4 * norm;
+
+	return residual;
+}
+#pragma endregion
+
+#pragma region T MadgwickUpdateIMU(QuaternionT<T> &q, T ax, T ay, T az, T gx, T gy, T gz, T beta, T deltat, T *bias, T zeta)
+/* Madgwick Quaternion Update without magnetometer
+Input: QuaternionT<T> &q - quaternion, updated in place, acceleration and gyro, T beta - filter gain, T deltat - time interval,
+       T *bias - T[3] gyro bias estimate updated with CompensateDrift, 0 disables it, T zeta - drift gain
+Output: T - magnitude of the gradient step before normalisation, 0 if acceleration was zero
+Description: gradient descent step towards measured gravity only, fused with integrated gyro rate. Heading is not
+             observed and drifts with the gyro, the gravity direction is the same as in the nine-axis update.
+*/
+template <typename T>
+T MadgwickUpdateIMU(QuaternionT<T> &q, T ax, T ay, T az, T gx, T gy, T gz, T beta, T deltat, T *bias = 0, T zeta = T(0))
+{
+	T q1 = q.w, q2 = q.x, q3 = q.y, q4 = q.z;   // short name local variable for readability
+	T norm;
+	T s1, s2, s3, s4;
+	T qDot1, qDot2, qDot3, qDot4;
+
+	// Auxiliary variables to avoid repeated arithmetic
+	T _2q1 = 2 * q1;
+	T _2q2 = 2 * q2;
+	T _2q3 = 2 * q3;
+	T _2q4 = 2 * q4;
+	T _4q1 = 4 * q1;
+	T _4q2 = 4 * q2;
+	T _4q3 = 4 * q3;
+	T _8q2 = 8 * q2;
+	T _8q3 = 8 * q3;
+	T q1q1 = q1 * q1;
+	T q2q2 = q2 * q2;
+	T q3q3 = q3 * q3;
+	T q4q4 = q4 * q4;
+
+	// Normalise accelerometer measurement
+	if (!Normalize(ax, ay, az)) return T(0);
+
+	// Gradient decent algorithm corrective step
+	s1 = _4q1 * q3q3 + _2q3 * ax + _4q1 * q2q2 - _2q2 * ay;
+	s2 = _4q2 * q4q4 - _2q4 * ax + 4 * q1q1 * q2 - _2q1 * ay - _4q2 + _8q2 * q2q2 + _8q2 * q3q3 + _4q2 * az;
+	s3 = 4 * q1q1 * q3 + _2q1 * ax + _4q3 * q4q4 - _2q4 * ay - _4q3 + _8q3 * q2q2 + _8q3 * q3q3 + _4q3 * az;
+	s4 = 4 * q2q2 * q4 - _2q2 * ax + 4 * q3q3 * q4 - _2q3 * ay;
+	T residual = NormalizeStep(s1, s2, s3, s4);    // normalise step magnitude
+
+	if (bias) {
+		CompensateDrift(q1, q2, q3, q4, s1, s2, s3, s4, gx, gy, gz, bias, zeta, deltat);
+	}
+
+	// Compute rate of change of quaternion
+	qDot1 = (-q2 * gx - q3 * gy - q4 * gz) / 2 - beta * s1;
+	qDot2 = (q1 * gx + q3 * gz - q4 * gy) / 2 - beta * s2;
+	qDot3 = (q1 * gy - q2 * gz + q4 * gx) / 2 - beta * s3;
+	qDot4 = (q1 * gz + q2 * gy - q3 * gx) / 2 - beta * s4;
+
+	// Integrate to yield quaternion
+	q1 += qDot1 * deltat;
+	q2 += qDot2 * deltat;
+	q3 += qDot3 * deltat;
+	q4 += qDot4 * deltat;
+	norm = InvSqrt(q1 * q1 + q2 * q2 + q3 * q3 + q4 * q4);    // normalise quaternion
+	q.w = q1 * norm;
+	q.x = q2 * norm;
+	q.y = q3 * norm;
+	q.z = q4 * norm;
+
+	return residual;
+}
+#pragma endregion
+
+#pragma region void MahonyUpdate(QuaternionT<T> &q, T ax, T ay, T az, T gx, T gy, T gz, T mx, T my, T mz, T *eInt, T kp, T ki, T deltat)
+/* Mahony Quaternion Update
+Input: QuaternionT<T> &q - quaternion, updated in place, acceleration, gyro and magnetic field, T *eInt - T[3]
+       integral error, updated in place, T kp, T ki - proportional and integral gain, T deltat - time interval
+Output: /
+Description: gyro rate corrected by proportional and integral feedback of the error between estimated and measured
+             directions of gravity and magnetic field
+*/
+template <typename T>
+void MahonyUpdate(QuaternionT<T> &q, T ax, T ay, T az, T gx, T gy, T gz, T mx, T my, T mz, T *eInt, T kp, T ki, T deltat)
+{
+	T q1 = q.w, q2 = q.x, q3 = q.y, q4 = q.z;   // short name local variable for readability
+	T norm;
+	T hx, hy, bx, bz;
+	T vx, vy, vz, wx, wy, wz;
+	T ex, ey, ez;
+	T pa, pb, pc;
+
+	// Auxiliary variables to avoid repeated arithmetic
+	T q1q1 = q1 * q1;
+	T q1q2 = q1 * q2;
+	T q1q3 = q1 * q3;
+	T q1q4 = q1 * q4;
+	T q2q2 = q2 * q2;
+	T q2q3 = q2 * q3;
+	T q2q4 = q2 * q4;
+	T q3q3 = q3 * q3;
+	T q3q4 = q3 * q4;
+	T q4q4 = q4 * q4;
+	T half = T(1) / 2;
+
+	// Normalise accelerometer and magnetometer measurement
+	if (!Normalize(ax, ay, az)) return;
+	if (!Normalize(mx, my, mz)) return;
+
+	// Reference direction of Earth's magnetic field
+	hx = 2 * mx * (half - q3q3 - q4q4) + 2 * my * (q2q3 - q1q4) + 2 * mz * (q2q4 + q1q3);
+	hy = 2 * mx * (q2q3 + q1q4) + 2 * my * (half - q2q2 - q4q4) + 2 * mz * (q3q4 - q1q2);
+	bx = Sqrt((hx * hx) + (hy * hy));
+	bz = 2 * mx * (q2q4 - q1q3) + 2 * my * (q3q4 + q1q2) + 2 * mz * (half - q2q2 - q3q3);
+
+	// Estimated direction of gravity and magnetic field
+	vx = 2 * (q2q4 - q1q3);
+	vy = 2 * (q1q2 + q3q4);
+	vz = q1q1 - q2q2 - q3q3 + q4q4;
+	wx = 2 * bx * (half - q3q3 - q4q4) + 2 * bz * (q2q4 - q1q3);
+	wy = 2 * bx * (q2q3 - q1q4) + 2 * bz * (q1q2 + q3q4);
+	wz = 2 * bx * (q1q3 + q2q4) + 2 * bz * (half - q2q2 - q3q3);
+
+	// Error is cross product between estimated direction and measured direction of gravity
+	ex = (ay * vz - az * vy) + (my * wz - mz * wy);
+	ey = (az * vx - ax * vz) + (mz * wx - mx * wz);
+	ez = (ax * vy - ay * vx) + (mx * wy - my * wx);
+	if (ki > T(0))
+	{
+		eInt[0] += ex;      // accumulate integral error
+		eInt[1] += ey;
+		eInt[2] += ez;
+	}
+	else
+	{
+		eInt[0] = T(0);     // prevent integral wind up
+		eInt[1] = T(0);
+		eInt[2] = T(0);
+	}
+
+	// Apply feedback terms
+	gx = gx + kp * ex + ki * eInt[0];
+	gy = gy + kp * ey + ki * eInt[1];
+	gz = gz + kp * ez + ki * eInt[2];
+
+	// Integrate rate of change of quaternion
+	T halfdt = deltat / 2;
+	pa = q2;
+	pb = q3;
+	pc = q4;
+	q1 = q1 + (-q2 * gx - q3 * gy - q4 * gz) * halfdt;
+	q2 = pa + (q1 * gx + pb * gz - pc * gy) * halfdt;
+	q3 = pb + (q1 * gy - pa * gz + pc * gx) * halfdt;
+	q4 = pc + (q1 * gz + pa * gy - pb * gx) * halfdt;
+
+	// Normalise quaternion
+	norm = InvSqrt(q1 * q1 + q2 * q2 + q3 * q3 + q4 * q4);
+	q.w = q1 * norm;
+	q.x = q2 * norm;
+	q.y = q3 * norm;
+	q.z = q4 * norm;
+}
+#pragma endregion
+
+#endif
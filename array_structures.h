@@ -2,16 +2,21 @@
 * MOTION ARRAY - used to store acceleration data and analyse it, used in the wave_analyser.h library
 * QUATERNION - used for quaternion manipulation in the MPU9250.h library
 * VECTOR FLOAT - used in quaternion class
+* Quaternion and vector are templated on the scalar type, float or Fixed from fixed_point.h
 */
 
 #ifndef _ARRAY_STRUCTURES_H_
 #define _ARRAY_STRUCTURES_H_
 
 #include <math.h>
-#include "filters.h" //Library including low pass filter
+#include "biquad.h" //Low pass filter
+#include "fixed_fft.h" //Q15 FFT for frequency domain integration
 #include "debug_print.h" //Additional library for debug logging
+#include "fixed_point.h" //Scalar type of quaternion and vector
 
 #define GRAV_CONSTANT 9.80665
+#define INTEGRATION_CUTOFF 0.05 //Lowest frequency kept in frequency domain integration, Hz
+#define FILTER_PAD_CHUNK 32 //Padding samples filtered per block in zero-phase mode
 
 class MotionArray {
 public:
@@ -20,12 +25,20 @@ public:
 	float dt; //Time interval
 	float d_last = 0.0;
 
-	Filter *filter; //Low pass filter
+	Biquad *filter; //Low pass filter
 
 	int N; //Length of array
+	int capacity; //Allocated length of x - frequency domain integration zero pads the array up to a power of 2
 	int N_gradient; //Length of gradient calculation
+	int N_pad; //Length of edge padding for zero-phase filtering
 	int n_elements = 0; //Number of elements in the array
+	int n_valid; //Number of valid elements for analysis - shorter after frequency domain integration
 	int pos = 0; //Position of next element to add
+	int start = 0; //Position of the first element of analysis window
+
+	bool continuous = false; //Denotes continuous acquisition into a ring with filtering on arrival
+	int N_hop = 0; //Number of new elements between analysis windows
+	int n_new = 0; //Number of new elements since last window
 
 	float half_period = 0.0; //Current half wave period
 
@@ -39,27 +52,30 @@ public:
 	* Initialize arrays to 0
 	*/
 	MotionArray(int n, int n_grad, float cutoff_freq, float sampling_time, int order) {
-		N = n;
-		N_gradient = n_grad;
-		if (N_gradient > (int)(N / 5)) { N_gradient = (int)(N / 5); } //Define the range of gradient
-
 
-		x = (int16_t *)malloc((N)*sizeof(int16_t));
-		dt = 0.0;
-		for (int i = 1; i < N; i++)
-		{
-			x[i] = 0;
-		}
+		x = (int16_t *)malloc((n)*sizeof(int16_t));
+		capacity = n;
+		owned = true;
+		SetSize(n, n_grad, cutoff_freq, sampling_time);
 
 		//Initialize filter
-		IIR::ORDER  ord; //Low pass filter order
-		if (order == 1) { ord = IIR::ORDER::OD1; }
-		else if (order == 2) { ord = IIR::ORDER::OD2; }
-		else if (order == 3) { ord = IIR::ORDER::OD3; }
-		else if (order == 4) { ord = IIR::ORDER::OD4; }
-		else { ord = IIR::ORDER::OD3; }
+		if (order < 1 || order > BIQUAD_MAX_ORDER) { order = 3; } //Low pass filter order
+		filter = new Biquad(cutoff_freq, sampling_time, order); //Define low-pass filter
+	}
+#pragma endregion
+
+#pragma region virtual float FilterIn(float _x)
+	/* Low pass filter hooks - derived arrays may provide their own filter */
+	virtual float FilterIn(float _x) {
+		return filter->filterIn(_x);
+	}
 
-		filter = new Filter(cutoff_freq, sampling_time, ord); //Define low-pass filter
+	virtual void FilterBlock(int16_t *data, int n) {
+		filter->process(data, data, n);
+	}
+
+	virtual void FilterInit() {
+		filter->init();
 	}
 #pragma endregion
 
@@ -76,9 +92,12 @@ public:
 		}
 		d_last = 0.0;
 		pos = 0;
+		start = 0;
+		n_new = 0;
+		n_valid = N;
 		dt = 0.0;
 		n_elements = 0;
-		filter->init();
+		FilterInit();
 	}
 #pragma endregion
 
@@ -94,6 +113,10 @@ public:
 	//Add new element - return gradient of calculation element
 	bool AddElement(int16_t _x, float _dt) {
 		
+		if (continuous) {
+			return AddContinuous(_x, _dt);
+		}
+
 		x[pos] = _x; //Add element at the next position
 		dt += _dt;
 		pos = (pos + 1) % N;
@@ -109,24 +132,136 @@ public:
 	}
 #pragma endregion
 
-#pragma region void FilterData()
+#pragma region void SetContinuous(float overlap)
+	/* Enable continuous acquisition
+	Input: float overlap - overlap of neighbouring analysis windows, fraction between 0 and 0.9
+	Output: /
+	Description: array becomes a ring of filtered elements, a new window is ready every N_hop elements
+	*/
+	void SetContinuous(float overlap) {
+		overlap = max(0.0f, min(0.9f, overlap));
+		continuous = true;
+		N_hop = max(1, (int)((1.0f - overlap) * (float)N));
+		Init();
+	}
+#pragma endregion
+
+#pragma region bool AddContinuous(int16_t _x, float _dt)
+	/* Add new element to the ring
+	Input: int16_t _x - new acceleration, float _dt - new time interval
+	Output: bool - true when a new analysis window is ready
+	Description:
+	* Filter new element on arrival - the filter runs uninterrupted over all windows, the ring holds filtered data
+	* Update running average of time interval over the ring
+	* Overwrite the oldest element
+	* When the ring is full and N_hop new elements arrived, the window starts at the oldest element
+	*/
+	bool AddContinuous(int16_t _x, float _dt) {
+
+		x[pos] = _x;
+		FilterBlock(&x[pos], 1);
+		if (n_elements < N) {
+			n_elements++;
+		}
+		dt += (_dt - dt) / (float)n_elements; //Running average
+		pos = (pos + 1) % N;
+		n_new++;
+
+		if (n_elements == N && n_new >= N_hop) {
+			n_new = 0;
+			start = pos;
+			return true;
+		}
+		return false;
+	}
+#pragma endregion
+
+#pragma region void FilterData(bool zero_phase)
 	/* Low pass filter on data
-	Input: /
+	Input: bool zero_phase - filter forward and backward
 	Output: /
 	Description: 
 	* Calculate average period
 	* Apply filter. 
+	* In zero-phase mode filter the data again in reverse direction, which cancels the phase lag and squares the magnitude response
 	*/
-	void FilterData() {
+	void FilterData(bool zero_phase = false) {
 
+		StartFilter();
+		if (zero_phase) {
+			FilterPass(1);
+			FilterPass(-1);
+			return;
+		}
+		FilterBlock(x, N);
+	}
+#pragma endregion
+
+#pragma region void StartFilter()
+	/* Prepare data for filtering
+	Input: /
+	Output: /
+	Description: calculate average period - call once before filtering element by element
+	*/
+	void StartFilter() {
 		pos = 0;
 		dt /= N; //Calculate average period
 		LOG(1, "DT: %.6f", dt);
 		//Adjust filter sampling time?
-		for (int i = 0; i < N; i++) {
+	}
+#pragma endregion
+
+#pragma region void FilterElement(int i)
+	/* Low pass filter one element in place
+	Input: int i - position, elements must be filtered in order
+	Output: /
+	*/
+	void FilterElement(int i) {
+		int16_t tmp = x[i];
+		FilterBlock(&x[i], 1);
+		LOG(2, ", %.6f, %d, %d", dt, tmp, x[i]);
+	}
+#pragma endregion
+
+#pragma region void FilterPass(int dir)
+	/* One filter pass in place
+	Input: int dir - 1 forward, -1 backward
+	Output: /
+	Description:
+	* Backward pass reverses the data in place, filters it forward and reverses it back, so both passes use the block filter
+	* Reset filter and settle it on N_pad samples of odd extension around the first element, 2 x[0] - x[k], saturated
+	  to int16_t. Padding is built and filtered in blocks of FILTER_PAD_CHUNK before the data is overwritten.
+	* Filter the data
+	*/
+	void FilterPass(int dir) {
+
+		if (dir < 0) {
+			Reverse();
+		}
+		FilterInit();
+		int16_t pad[FILTER_PAD_CHUNK];
+		for (int k = N_pad; k > 0;) {
+			int n = min(k, FILTER_PAD_CHUNK);
+			for (int j = 0; j < n; j++, k--) {
+				long p = 2L * x[0] - x[k];
+				pad[j] = (int16_t)max(-32768L, min(32767L, p));
+			}
+			FilterBlock(pad, n);
+		}
+		FilterBlock(x, N);
+		if (dir < 0) {
+			Reverse();
+		}
+	}
+#pragma endregion
+
+#pragma region void Reverse()
+	/* Reverse order of the data in place */
+	void Reverse() {
+		for (int i = 0, j = N - 1; i < j; i++, j--) {
 			int16_t tmp = x[i];
-			x[i] = (int16_t) filter->filterIn((float) x[i]);
-			LOG(2, ", %.6f, %d, %d", dt, tmp, x[i]);
+			x[i] = x[j];
+			x[j] = tmp;
 		}
 	}
 #pragma endregion
@@ -144,15 +279,19 @@ public:
 
 		float v = 0.0; //Zero velocity at top and bottom
 		float d = 0.0; //Zero displacement at top and bottom
+		float a_last = ((float)getElement(start) - (float)offset1) * GRAV_CONSTANT / 1000.0f;
 
-		//Loop till end index
-		for (int i = start; i <= end; i++) {
+		//Loop till end index - trapezoidal rule, accurate also at decimated sampling rates
+		for (int i = start + 1; i <= end; i++) {
 
 			float relative_pos = (float)(i - start) / (float)(end - start);
 			float offset = ((1.0 - relative_pos) * (float)offset1 + relative_pos * (float)offset2);
-			v += dt * (((float)x[i] - offset) * GRAV_CONSTANT / 1000.0f); //Update velocity
-			d += dt * v; //Update displacement
-			d_last += dt * v;
+			float a = ((float)getElement(i) - offset) * GRAV_CONSTANT / 1000.0f;
+			float v_new = v + dt * 0.5f * (a_last + a); //Update velocity
+			d += dt * 0.5f * (v + v_new); //Update displacement
+			d_last += dt * 0.5f * (v + v_new);
+			v = v_new;
+			a_last = a;
 		}
 		half_period = dt * (float)(end - start); //Update half period
 
@@ -160,15 +299,174 @@ public:
 	}
 #pragma endregion 
 
+#pragma region int PaddedLength()
+	/* Length of frequency domain integration
+	Input: /
+	Output: int - smallest power of 2 not shorter than the array, at most FFT_MAX
+	*/
+	int PaddedLength() {
+		int len = 1;
+		while (len < N && 2 * len <= FFT_MAX) {
+			len *= 2;
+		}
+		return len;
+	}
+#pragma endregion
+
+#pragma region bool Reserve(int n)
+	/* Reserve storage for zero padding
+	Input: int n - required length of x
+	Output: bool - false if the array does not own its storage, or it can not be enlarged
+	Description: reallocate heap storage, the first N elements are kept
+	*/
+	bool Reserve(int n) {
+		if (n <= capacity) {
+			return true;
+		}
+		if (!owned) {
+			return false;
+		}
+		int16_t *x_new = (int16_t *)realloc(x, (n)*sizeof(int16_t));
+		if (x_new == NULL) {
+			return false;
+		}
+		x = x_new;
+		capacity = n;
+		return true;
+	}
+#pragma endregion
+
+#pragma region int IntegrateDisplacement(float f_cut)
+	/* Frequency domain double integration
+	Input: float f_cut - lowest frequency kept, Hz
+	Output: int - number of valid displacement elements, the rest of array is not valid
+	Description:
+	* Integrate the whole record, zero padded to the next power of 2 (see PaddedLength and Reserve). If the storage
+	  is too short for padding, or the record is longer than FFT_MAX, only the longest power of 2 part that fits is integrated
+	* Remove mean value and taper both ends with a half Hann window of 1/10 of the record,
+	  then fill the padding with zeros - bins below f_cut remove the low frequency leakage that 1/w^2 amplifies most
+	* Scale data to full Q15 range and calculate real FFT in place
+	* Multiply each bin with -g/w^2, which turns acceleration in mg into displacement in mm. Remove bins below f_cut.
+	* Calculate inverse FFT and store displacement in mm of the untapered middle to the start of the array - heave of the
+	  tapered ends is attenuated and would bias wave heights low
+	*/
+	int IntegrateDisplacement(float f_cut) {
+
+		int len = PaddedLength();
+		while (len > capacity) {
+			len /= 2;
+		}
+		int n = min(N, len); //Analysed length
+		if (len < 64 || dt <= 0.0) {
+			return 0;
+		}
+
+		//Remove mean, taper and pad with zeros
+		int32_t sum = 0;
+		for (int i = 0; i < n; i++) {
+			sum += x[i];
+		}
+		int16_t mean = (int16_t)(sum / n);
+		int taper = n / 10;
+		for (int i = 0; i < n; i++) {
+			x[i] -= mean;
+		}
+		for (int i = 0; i < taper; i++) {
+			int16_t w = (int16_t)((32767 - FixedFFT::Cos(i, 2 * taper)) >> 1);
+			x[i] = FixedFFT::Multiply(x[i], w);
+			x[n - 1 - i] = FixedFFT::Multiply(x[n - 1 - i], w);
+		}
+		for (int i = n; i < len; i++) {
+			x[i] = 0;
+		}
+
+		int exponent = FixedFFT::Normalize(x, len);
+		exponent += FixedFFT::Real(x, len);
+
+		//Largest integrated bin defines common scale
+		float df = 1.0 / ((float)len * dt);
+		float max_bin = 0.0;
+		for (int k = 1; k < len / 2; k++) {
+			float f = (float)k * df;
+			if (f < f_cut) {
+				continue;
+			}
+			float w = 2.0 * PI * f;
+			float g = GRAV_CONSTANT / (w * w);
+			float m = g * (float)max(abs(x[2 * k]), abs(x[2 * k + 1]));
+			if (m > max_bin) {
+				max_bin = m;
+			}
+		}
+		int shift = 0;
+		while (max_bin > (float)FFT_HEADROOM) {
+			max_bin /= 2.0;
+			shift++;
+		}
+		exponent += shift;
+
+		//Integrate
+		x[0] = 0; //DC
+		x[1] = 0; //Nyquist
+		for (int k = 1; k < len / 2; k++) {
+			float f = (float)k * df;
+			if (f < f_cut) {
+				x[2 * k] = 0;
+				x[2 * k + 1] = 0;
+				continue;
+			}
+			float w = 2.0 * PI * f;
+			float g = -ldexpf(GRAV_CONSTANT / (w * w), -shift);
+			x[2 * k] = (int16_t)lroundf(g * (float)x[2 * k]);
+			x[2 * k + 1] = (int16_t)lroundf(g * (float)x[2 * k + 1]);
+		}
+
+		exponent += FixedFFT::Normalize(x, len);
+		exponent += FixedFFT::RealInverse(x, len);
+
+		//Store displacement in mm
+		for (int i = 0; i < n - 2 * taper; i++) {
+			int32_t d = x[i + taper];
+			d = (exponent >= 0) ? (d << exponent) : ((d + (1 << (-exponent - 1))) >> -exponent);
+			x[i] = (int16_t)max(-32768L, min(32767L, (long)d));
+		}
+
+		n_valid = n - 2 * taper;
+		return n_valid;
+	}
+#pragma endregion
+
+#pragma region float CalculateHeight(int start, int end)
+	/* Calculate height from displacement
+	Input: int start, int end - positions of two neighbouring extremes
+	Output: float - height in m
+	Description: array holds displacement in mm after IntegrateDisplacement, height is the difference between extremes
+	*/
+	float CalculateHeight(int start, int end) {
+		half_period = dt * (float)(end - start); //Update half period
+		return(abs((float)(getElement(end) - getElement(start))) / 1000.0);
+	}
+#pragma endregion
+
 #pragma region float getHalfPeriod()
 	float getHalfPeriod() {
 		return(half_period);
 	}
 #pragma endregion
 
+#pragma region int getLength()
+	int getLength() {
+		return(n_valid);
+	}
+#pragma endregion
+
 #pragma region int16_t getElement(int i)
 	int16_t getElement(int i) {
-		return x[i];
+		int j = start + i; //Position in the ring
+		if (j >= N) {
+			j -= N;
+		}
+		return x[j];
 	}
 #pragma endregion
 
@@ -185,8 +483,8 @@ public:
 
 		//Determine positions of gradient calculation
 		int i_min = max(0, i - N_gradient); //Position of the first element
-		int	i_max = min(N - 1, i + N_gradient); //position of the second element
-		float grad = (float)(x[i_max] - x[i_min]); //Gradient calculation (non-scaled!)
+		int	i_max = min(n_valid - 1, i + N_gradient); //position of the second element
+		float grad = (float)(getElement(i_max) - getElement(i_min)); //Gradient calculation (non-scaled!)
 
 		//Return gradient
 		if (grad > 0.0) {
@@ -201,120 +499,171 @@ public:
 	}
 #pragma endregion
 
+protected:
+
+	bool owned; //Storage is on the heap and can be enlarged
+
+#pragma region MotionArray(int16_t *buffer, int n, int n_grad, float cutoff_freq, float sampling_time, int cap)
+	/* Construct motion array on given storage, without filter - used by derived arrays with their own filter
+	Input: int16_t *buffer - storage of length cap, int n - length of motion array, int n_grad - number of points used in gradient calculation,
+	       float cutoff_freq, float sampling_time - used for zero-phase padding length, int cap - length of storage, at least n
+	*/
+	MotionArray(int16_t *buffer, int n, int n_grad, float cutoff_freq, float sampling_time, int cap) {
+		x = buffer;
+		capacity = max(n, cap);
+		owned = false;
+		filter = NULL;
+		SetSize(n, n_grad, cutoff_freq, sampling_time);
+	}
+#pragma endregion
+
+#pragma region void SetSize(int n, int n_grad, float cutoff_freq, float sampling_time)
+	/* Set array dimensions
+	Input: int n - length of motion array, int n_grad - number of points used in gradient calculation,
+	       float cutoff_freq, float sampling_time - used for zero-phase padding length
+	Output: /
+	Description:
+	* Check that gradient calculation points are not to big, relative to array size
+	* Initialize array to 0
+	*/
+	void SetSize(int n, int n_grad, float cutoff_freq, float sampling_time) {
+		N = n;
+		n_valid = N;
+		N_gradient = n_grad;
+		if (N_gradient > (int)(N / 5)) { N_gradient = (int)(N / 5); } //Define the range of gradient
+		N_pad = (int)(2.0 / (cutoff_freq * sampling_time)); //Two periods of cutoff frequency to settle the filter
+		if (N_pad > N - 1) { N_pad = N - 1; }
+
+		dt = 0.0;
+		for (int i = 1; i < N; i++)
+		{
+			x[i] = 0;
+		}
+	}
+#pragma endregion
+
 };
 
-class Quaternion {
+template <typename T>
+class QuaternionT {
 public:
-	float w;
-	float x;
-	float y;
-	float z;
-
-	Quaternion() {
-		w = 1.0f;
-		x = 0.0f;
-		y = 0.0f;
-		z = 0.0f;
+	T w;
+	T x;
+	T y;
+	T z;
+
+	QuaternionT() {
+		w = T(1);
+		x = T(0);
+		y = T(0);
+		z = T(0);
 	}
 
-	Quaternion(float nw, float nx, float ny, float nz) {
+	QuaternionT(T nw, T nx, T ny, T nz) {
 		w = nw;
 		x = nx;
 		y = ny;
 		z = nz;
 	}
 
-	Quaternion getProduct(Quaternion q) {
+	QuaternionT getProduct(QuaternionT q) {
 		// Quaternion multiplication is defined by:
 		//     (Q1 * Q2).w = (w1w2 - x1x2 - y1y2 - z1z2)
 		//     (Q1 * Q2).x = (w1x2 + x1w2 + y1z2 - z1y2)
 		//     (Q1 * Q2).y = (w1y2 - x1z2 + y1w2 + z1x2)
 		//     (Q1 * Q2).z = (w1z2 + x1y2 - y1x2 + z1w2
-		return Quaternion(
+		return QuaternionT(
 			w*q.w - x*q.x - y*q.y - z*q.z,  // new w
 			w*q.x + x*q.w + y*q.z - z*q.y,  // new x
 			w*q.y - x*q.z + y*q.w + z*q.x,  // new y
 			w*q.z + x*q.y - y*q.x + z*q.w); // new z
 	}
 
-	Quaternion getConjugate() {
-		return Quaternion(w, -x, -y, -z);
+	QuaternionT getConjugate() {
+		return QuaternionT(w, -x, -y, -z);
 	}
 
-	float getMagnitude() {
-		return sqrt(w*w + x*x + y*y + z*z);
+	T getMagnitude() {
+		return Sqrt(w*w + x*x + y*y + z*z);
 	}
 
 	void normalize() {
-		float m = getMagnitude();
-		w /= m;
-		x /= m;
-		y /= m;
-		z /= m;
+		T m = InvSqrt(w*w + x*x + y*y + z*z);
+		w *= m;
+		x *= m;
+		y *= m;
+		z *= m;
 	}
 
-	Quaternion getNormalized() {
-		Quaternion r(w, x, y, z);
+	QuaternionT getNormalized() {
+		QuaternionT r(w, x, y, z);
 		r.normalize();
 		return r;
 	}
 };
 
-class VectorFloat {
+template <typename T>
+class VectorT {
 public:
-	float x;
-	float y;
-	float z;
-
-	VectorFloat() {
-		x = 0;
-		y = 0;
-		z = 0;
+	T x;
+	T y;
+	T z;
+
+	VectorT() {
+		x = T(0);
+		y = T(0);
+		z = T(0);
 	}
 
-	VectorFloat(float nx, float ny, float nz) {
+	VectorT(T nx, T ny, T nz) {
 		x = nx;
 		y = ny;
 		z = nz;
 	}
 
-	float getMagnitude() {
-		return sqrt(x*x + y*y + z*z);
+	T getMagnitude() {
+		return Sqrt(x*x + y*y + z*z);
 	}
 
 	void normalize() {
-		float m = getMagnitude();
-		x /= m;
-		y /= m;
-		z /= m;
+		T m = InvSqrt(x*x + y*y + z*z);
+		x *= m;
+		y *= m;
+		z *= m;
 	}
 
-	VectorFloat getNormalized() {
-		VectorFloat r(x, y, z);
+	VectorT getNormalized() {
+		VectorT r(x, y, z);
 		r.normalize();
 		return r;
 	}
 
-	void rotate(Quaternion *q) {
-		Quaternion p(0, x, y, z);
-
-		// quaternion multiplication: q * p, stored back in p
-		p = q->getProduct(p);
+	void rotate(QuaternionT<T> *q) {
+		// q * p * conj(q) written as rotation matrix rows, same result as two quaternion products
+		T ww = q->w*q->w, xx = q->x*q->x, yy = q->y*q->y, zz = q->z*q->z;
+		T xy = q->x*q->y, xz = q->x*q->z, yz = q->y*q->z;
+		T wx = q->w*q->x, wy = q->w*q->y, wz = q->w*q->z;
 
-		// quaternion multiplication: p * conj(q), stored back in p
-		p = p.getProduct(q->getConjugate());
+		T nx = (ww + xx - yy - zz)*x + 2 * (xy - wz)*y + 2 * (xz + wy)*z;
+		T ny = 2 * (xy + wz)*x + (ww - xx + yy - zz)*y + 2 * (yz - wx)*z;
+		z = 2 * (xz - wy)*x + 2 * (yz + wx)*y + (ww - xx - yy + zz)*z;
+		x = nx;
+		y = ny;
+	}
 
-		// p quaternion is now [0, x', y', z']
-		x = p.x;
-		y = p.y;
-		z = p.z;
+	T getRotatedZ(QuaternionT<T> *q) {
+		// Only the last row of the rotation matrix - vertical component in the earth frame
+		return 2 * (q->x*q->z - q->w*q->y)*x + 2 * (q->y*q->z + q->w*q->x)*y + (q->w*q->w - q->x*q->x - q->y*q->y + q->z*q->z)*z;
 	}
 
-	VectorFloat getRotated(Quaternion *q) {
-		VectorFloat r(x, y, z);
+	VectorT getRotated(QuaternionT<T> *q) {
+		VectorT r(x, y, z);
 		r.rotate(q);
 		return r;
 	}
 };
 
+typedef QuaternionT<float> Quaternion; //Float quaternion used by the MPU9250
+typedef VectorT<float> VectorFloat;
+
 #endif 
\ No newline at end of file
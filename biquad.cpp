@@ -0,0 +1,202 @@
+#include "biquad.h"
+
+#define BIQUAD_FRACTION 14 //Fractional bits of samples inside the fixed point cascade
+
+#pragma region Biquad::Biquad(float cutoff_freq, float sampling_time, int order, int type, int backend, float upper_freq)
+/* Biquad constructor
+Input:
+* float cutoff_freq - cutoff frequency, lower frequency of band pass
+* float sampling_time - sampling time in s
+* int order - filter order between 1 and BIQUAD_MAX_ORDER, order of each part of band pass
+* int type - BIQUAD_LOWPASS, BIQUAD_HIGHPASS or BIQUAD_BANDPASS
+* int backend - BIQUAD_FLOAT, BIQUAD_Q15 or BIQUAD_Q31
+* float upper_freq - upper frequency of band pass
+Description: allocate coefficients and states of the largest cascade, design sections and reset states
+*/
+Biquad::Biquad(float cutoff_freq, float sampling_time, int order, int type, int backend_, float upper_freq) {
+
+	backend = backend_;
+	order = max(1, min(BIQUAD_MAX_ORDER, order));
+	int max_sections = 2 * ((order + 1) / 2);
+
+	coef_f = (float *)malloc((5 * max_sections)*sizeof(float));
+	state_f = (float *)malloc((2 * max_sections)*sizeof(float));
+	coef_q = (int32_t *)malloc((5 * max_sections)*sizeof(int32_t));
+	state_q = (int64_t *)malloc((2 * max_sections)*sizeof(int64_t));
+
+	if (type == BIQUAD_HIGHPASS || type == BIQUAD_BANDPASS) {
+		design(cutoff_freq, sampling_time, order, true);
+	}
+	if (type == BIQUAD_LOWPASS) {
+		design(cutoff_freq, sampling_time, order, false);
+	}
+	if (type == BIQUAD_BANDPASS) {
+		design(upper_freq, sampling_time, order, false);
+	}
+
+	init();
+}
+#pragma endregion
+
+#pragma region void Biquad::init()
+/* Reset filter states
+Input: /
+Output: /
+*/
+void Biquad::init() {
+	for (int i = 0; i < 2 * n_sections; i++) {
+		state_f[i] = 0.0;
+		state_q[i] = 0;
+	}
+}
+#pragma endregion
+
+#pragma region void Biquad::design(float freq, float sampling_time, int order, bool highpass)
+/* Design Butterworth sections
+Input: float freq - cutoff frequency, float sampling_time, int order, bool highpass - high pass instead of low pass
+Output: /
+Description:
+* Prewarp cutoff with K = tan(PI fc Ts)
+* Each pole pair k has quality factor Q = 1 / (2 sin((2k + 1) PI / 2n)), bilinear transform gives the section
+* Odd order adds a first order section
+*/
+void Biquad::design(float freq, float sampling_time, int order, bool highpass) {
+
+	float k = tan(PI * freq * sampling_time);
+	float k2 = k * k;
+
+	for (int i = 0; i < order / 2; i++) {
+		float q = 1.0 / (2.0 * sin((2.0 * i + 1.0) * PI / (2.0 * order)));
+		float norm = 1.0 / (1.0 + k / q + k2);
+		float a1 = 2.0 * (k2 - 1.0) * norm;
+		float a2 = (1.0 - k / q + k2) * norm;
+		if (highpass) {
+			addSection(norm, -2.0 * norm, norm, a1, a2);
+		}
+		else {
+			addSection(k2 * norm, 2.0 * k2 * norm, k2 * norm, a1, a2);
+		}
+	}
+	if (order % 2) {
+		float a1 = (k - 1.0) / (k + 1.0);
+		if (highpass) {
+			addSection(1.0 / (1.0 + k), -1.0 / (1.0 + k), 0.0, a1, 0.0);
+		}
+		else {
+			addSection(k / (1.0 + k), k / (1.0 + k), 0.0, a1, 0.0);
+		}
+	}
+}
+#pragma endregion
+
+#pragma region void Biquad::addSection(float b0, float b1, float b2, float a1, float a2)
+/* Add section to the cascade
+Input: float b0, b1, b2, a1, a2 - section coefficients, a0 = 1
+Output: /
+Description: store float coefficients and fixed point coefficients with 30 fractional bits, or 14 for Q15 backend
+*/
+void Biquad::addSection(float b0, float b1, float b2, float a1, float a2) {
+
+	float c[5] = { b0, b1, b2, a1, a2 };
+	int shift = (backend == BIQUAD_Q15) ? 14 : 30;
+	for (int i = 0; i < 5; i++) {
+		coef_f[5 * n_sections + i] = c[i];
+		coef_q[5 * n_sections + i] = (int32_t)llroundf(ldexpf(c[i], shift));
+	}
+	n_sections++;
+}
+#pragma endregion
+
+#pragma region void Biquad::process(int16_t *in, int16_t *out, int n)
+/* Filter block of samples
+Input: int16_t *in - input samples, int16_t *out - output samples, int n - number of samples
+Output: /
+Description: run samples through all sections, round and saturate the output. Filtering in place is allowed.
+*/
+void Biquad::process(int16_t *in, int16_t *out, int n) {
+
+	if (backend == BIQUAD_FLOAT) {
+		for (int i = 0; i < n; i++) {
+			float y = filterIn((float)in[i]);
+			out[i] = (int16_t)max(-32768L, min(32767L, lroundf(y)));
+		}
+		return;
+	}
+
+	for (int i = 0; i < n; i++) {
+		int32_t y = step((int32_t)in[i] << BIQUAD_FRACTION);
+		y = (y + (1L << (BIQUAD_FRACTION - 1))) >> BIQUAD_FRACTION;
+		out[i] = (int16_t)max(-32768L, min(32767L, (long)y));
+	}
+}
+#pragma endregion
+
+#pragma region float Biquad::filterIn(float x)
+/* Filter single sample
+Input: float x - new sample
+Output: float - filtered sample
+Description: direct form II transposed sections, y = b0 x + s0, s0 = b1 x - a1 y + s1, s1 = b2 x - a2 y
+*/
+float Biquad::filterIn(float x) {
+
+	if (backend != BIQUAD_FLOAT) {
+		float xq = max(-1.0e9f, min(1.0e9f, ldexpf(x, BIQUAD_FRACTION)));
+		return ldexpf((float)step((int32_t)lroundf(xq)), -BIQUAD_FRACTION);
+	}
+
+	for (int s = 0; s < n_sections; s++) {
+		float *c = &coef_f[5 * s];
+		float *z = &state_f[2 * s];
+		float y = c[0] * x + z[0];
+		z[0] = c[1] * x - c[3] * y + z[1];
+		z[1] = c[2] * x - c[4] * y;
+		x = y;
+	}
+	return x;
+}
+#pragma endregion
+
+#pragma region int32_t Biquad::step(int32_t x)
+/* Filter one sample through fixed point cascade
+Input: int32_t x - sample with 14 fractional bits
+Output: int32_t - filtered sample with 14 fractional bits
+Description:
+* Products of coefficients and samples are accumulated in 64 bits, states keep the full product precision
+* Output of each section is rounded back to 14 fractional bits and passed to the next section
+* Q15 backend works on integer samples and keeps states and products in 32 bits - they can not overflow for samples
+  within +-8192
+*/
+int32_t Biquad::step(int32_t x) {
+
+	int shift = (backend == BIQUAD_Q15) ? 14 : 30;
+	int64_t half = (int64_t)1 << (shift - 1);
+
+	for (int s = 0; s < n_sections; s++) {
+		int32_t *c = &coef_q[5 * s];
+		int64_t *z = &state_q[2 * s];
+		int32_t y;
+		if (backend == BIQUAD_Q15) {
+			int32_t xi = (x + (1L << (BIQUAD_FRACTION - 1))) >> BIQUAD_FRACTION; //Integer sample
+			int32_t acc = c[0] * xi + (int32_t)z[0];
+			int32_t yi = (acc + (int32_t)half) >> shift;
+			z[0] = c[1] * xi - c[3] * yi + (int32_t)z[1];
+			z[1] = c[2] * xi - c[4] * yi;
+			y = yi << BIQUAD_FRACTION;
+		}
+		else {
+			int64_t acc = (int64_t)c[0] * x + z[0];
+			y = (int32_t)((acc + half) >> shift);
+			z[0] = (int64_t)c[1] * x - (int64_t)c[3] * y + z[1];
+			z[1] = (int64_t)c[2] * x - (int64_t)c[4] * y;
+		}
+		x = y;
+	}
+	return x;
+}
+#pragma endregion
+
+// GET FUNCTIONS
+
+int Biquad::getSections() {
+	return n_sections;
+}
@@ -0,0 +1,53 @@
+/* BIQUAD class - cascaded second order section IIR filter used in the wave_analyser.h library
+* Butterworth low pass, high pass and band pass filters are designed with the bilinear transform into a cascade of
+* second order sections, an odd order adds a first order section. Sections run in direct form II transposed.
+* Three backends are available:
+* FLOAT - float coefficients and states
+* Q31 - Q2.30 coefficients, samples with 14 fractional bits in 32 bits and 64 bit states. Accurate also for very low
+  cutoff relative to sampling frequency, e.g. 0.4 Hz at 100 Hz, and no soft-float operations per sample.
+* Q15 - Q2.14 coefficients and 32 bit states. Cheapest, but coefficients of low cutoff filters lose precision - use it
+  for cutoff above about 1 % of the sampling frequency, e.g. after decimation.
+* Band pass is a cascade of high pass at the lower and low pass at the upper frequency, both of given order.
+*/
+
+#ifndef _BIQUAD_H_
+#define _BIQUAD_H_
+
+#include <Arduino.h>
+
+#define BIQUAD_LOWPASS 0 //Filter types
+#define BIQUAD_HIGHPASS 1
+#define BIQUAD_BANDPASS 2
+
+#define BIQUAD_FLOAT 0 //Backends
+#define BIQUAD_Q15 1
+#define BIQUAD_Q31 2
+
+#define BIQUAD_MAX_ORDER 8 //Highest order of each low pass or high pass part
+
+class Biquad {
+public:
+
+	Biquad(float cutoff_freq, float sampling_time, int order, int type = BIQUAD_LOWPASS, int backend = BIQUAD_Q31, float upper_freq = 0.0); //Constructor
+	void init(); //Reset filter states
+	void process(int16_t *in, int16_t *out, int n); //Filter block of samples, in and out may be the same array
+	float filterIn(float x); //Filter single sample
+
+	int getSections(); //Number of sections
+
+private:
+
+	int backend; //Backend
+	int n_sections = 0; //Number of sections
+
+	float *coef_f; //Float coefficients, 5 per section: b0, b1, b2, a1, a2
+	float *state_f; //Float states, 2 per section
+	int32_t *coef_q; //Fixed point coefficients, 5 per section
+	int64_t *state_q; //Fixed point states, 2 per section
+
+	void design(float freq, float sampling_time, int order, bool highpass); //Add Butterworth sections
+	void addSection(float b0, float b1, float b2, float a1, float a2); //Add section to the cascade
+	int32_t step(int32_t x); //Filter one sample with 14 fractional bits through fixed point cascade
+};
+
+#endif
@@ -0,0 +1,145 @@
+#include "data_quality.h"
+
+#pragma region DataQuality::DataQuality()
+/* DataQuality constructor */
+DataQuality::DataQuality() {
+	Init();
+}
+#pragma endregion
+
+#pragma region void DataQuality::Init()
+/* Initialization
+Input: /
+Output: /
+Description: reset held sample, timing and flags
+*/
+void DataQuality::Init() {
+	n_out = 0;
+	started = false;
+	emitted = false;
+	held = 0;
+	held_dt = 0.0;
+	prev = 0;
+	dt_pending = 0.0;
+	dt_avg = 0.0;
+	run = 0;
+	flags = 0;
+}
+#pragma endregion
+
+#pragma region int DataQuality::AddElement(int16_t _x, float _dt, bool clipped, bool valid)
+/* Add new element
+Input: int16_t _x - new acceleration in mg, float _dt - new time interval, bool clipped - sensor was at full scale,
+       bool valid - sample was read without errors
+Output: int - number of checked samples, read them with getElement and getDt
+Description:
+* Invalid sample is dropped, its time interval is added to the next one
+* Number of missing samples is estimated from the time interval relative to the average of regular intervals
+* The held sample is checked for a spike against the last checked and the new sample, then it is output
+* Short gap between the held and the new sample is filled by linear interpolation, a longer gap is flagged as dropout
+* The new sample is held until the next one arrives
+*/
+int DataQuality::AddElement(int16_t _x, float _dt, bool clipped, bool valid) {
+
+	n_out = 0;
+	dt_pending += _dt;
+	if (clipped) {
+		flags |= QC_CLIPPING;
+	}
+	if (!valid) {
+		flags |= QC_READ_ERROR;
+		return 0;
+	}
+	float dt = dt_pending;
+	dt_pending = 0.0;
+
+	if (!started) {
+		started = true;
+		held = _x;
+		held_dt = dt;
+		dt_avg = dt;
+		return 0;
+	}
+
+	//Missing samples
+	int k = (dt_avg > 0.0) ? (int)(dt / dt_avg + 0.5) - 1 : 0;
+	if (k <= 0) {
+		k = 0;
+		dt_avg += (dt - dt_avg) / (float)QC_DT_AVERAGE;
+	}
+
+	//Spike of the held sample
+	if (k == 0 && emitted) {
+		int32_t d_prev = (int32_t)held - prev;
+		int32_t d_next = (int32_t)held - _x;
+		if (abs(d_prev) > QC_SPIKE_LIMIT && abs(d_next) > QC_SPIKE_LIMIT && (d_prev > 0) == (d_next > 0) &&
+			abs((int32_t)_x - prev) <= QC_SPIKE_LIMIT) {
+			held = (int16_t)(((int32_t)prev + _x) / 2);
+			flags |= QC_SPIKE;
+		}
+	}
+	emit(held, held_dt);
+
+	//Gap
+	if (k > QC_MAX_GAP) {
+		flags |= QC_DROPOUT;
+		held_dt = dt;
+	}
+	else if (k > 0) {
+		float step = dt / (float)(k + 1);
+		for (int j = 1; j <= k; j++) {
+			emit((int16_t)(prev + ((int32_t)_x - prev) * j / (k + 1)), step);
+		}
+		flags |= QC_GAP;
+		held_dt = step;
+	}
+	else {
+		held_dt = dt;
+	}
+	held = _x;
+	return n_out;
+}
+#pragma endregion
+
+#pragma region void DataQuality::emit(int16_t _x, float _dt)
+/* Output checked sample
+Input: int16_t _x - sample, float _dt - its time interval
+Output: /
+Description: store sample for the caller and count identical samples in a row
+*/
+void DataQuality::emit(int16_t _x, float _dt) {
+	out[n_out] = _x;
+	out_dt[n_out] = _dt;
+	n_out++;
+
+	if (emitted && _x == prev) {
+		run++;
+		if (run >= QC_FLATLINE_COUNT - 1) {
+			flags |= QC_FLATLINE;
+		}
+	}
+	else {
+		run = 0;
+	}
+	prev = _x;
+	emitted = true;
+}
+#pragma endregion
+
+void DataQuality::ClearFlags() {
+	flags = 0;
+}
+
+// GET FUNCTIONS
+
+int16_t DataQuality::getElement(int i) {
+	return out[i];
+}
+
+float DataQuality::getDt(int i) {
+	return out_dt[i];
+}
+
+uint8_t DataQuality::getFlags() {
+	return flags;
+}
@@ -0,0 +1,61 @@
+/* DATA QUALITY class - inline quality control of acceleration samples used in the wave_analyser.h library
+* Each sample passes the check before it is analysed, with a latency of one sample:
+* CLIPPING - sensor reported acceleration at full scale
+* READ_ERROR - no new sample was read, e.g. on I2C error - its time interval is added to the next sample
+* GAP - time interval is 2 to QC_MAX_GAP + 1 times the average, missing samples are linearly interpolated
+* DROPOUT - longer gap, it is not repaired
+* SPIKE - single sample departs from both neighbours in the same direction by more than QC_SPIKE_LIMIT,
+  while the neighbours agree - it is replaced by their mean
+* FLATLINE - QC_FLATLINE_COUNT identical samples in a row, e.g. stuck sensor
+* Flags are accumulated until cleared. Bit 0 is left free for the packet status.
+*/
+
+#ifndef _DATA_QUALITY_H_
+#define _DATA_QUALITY_H_
+
+#include <Arduino.h>
+
+#define QC_CLIPPING 0x02 //Flags
+#define QC_SPIKE 0x04
+#define QC_FLATLINE 0x08
+#define QC_DROPOUT 0x10
+#define QC_GAP 0x20
+#define QC_READ_ERROR 0x40
+
+#define QC_SPIKE_LIMIT 300 //Spike departure from neighbours in mg
+#define QC_FLATLINE_COUNT 50 //Number of identical samples considered stuck
+#define QC_MAX_GAP 4 //Max number of missing samples repaired by interpolation
+#define QC_DT_AVERAGE 16 //Averaging length of time interval
+
+class DataQuality {
+public:
+
+	DataQuality(); //Constructor
+	void Init(); //Initialization
+	int AddElement(int16_t _x, float _dt, bool clipped = false, bool valid = true); //Add new sample - return number of checked samples
+
+	int16_t getElement(int i); //Checked sample i of the last call
+	float getDt(int i); //Time interval of checked sample i
+	uint8_t getFlags(); //Accumulated flags
+	void ClearFlags(); //Clear accumulated flags
+
+private:
+
+	int16_t out[QC_MAX_GAP + 1]; //Checked samples of the last call
+	float out_dt[QC_MAX_GAP + 1]; //Their time intervals
+	int n_out = 0; //Number of checked samples of the last call
+
+	bool started = false; //Denotes if a sample is held
+	bool emitted = false; //Denotes if a sample was checked
+	int16_t held = 0; //Sample waiting for the next one
+	float held_dt = 0.0; //Its time interval
+	int16_t prev = 0; //Last checked sample
+	float dt_pending = 0.0; //Time interval of unread samples
+	float dt_avg = 0.0; //Average time interval
+	int run = 0; //Number of identical samples in a row
+	uint8_t flags = 0; //Accumulated flags
+
+	void emit(int16_t _x, float _dt); //Output checked sample
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "decimator.h"
+
+#pragma region Decimator::Decimator(int factor)
+/* Decimator constructor
+Input: int factor - decimation factor
+Description:
+* Allocate coefficients and delay ring of DECIMATION_TAPS * factor taps
+* Design Hann windowed sinc with cutoff 1 / (3 factor) of the input sampling frequency
+* Round coefficients to Q15 and correct the center tap, so the DC gain is exactly 1
+*/
+Decimator::Decimator(int factor) {
+
+	M = max(1, factor);
+	L = DECIMATION_TAPS * M + 1; //Odd length - symmetric around the center tap
+
+	h = (int16_t *)malloc((L)*sizeof(int16_t));
+	delay = (int16_t *)malloc((L)*sizeof(int16_t));
+
+	float fc = 1.0 / (3.0 * (float)M); //Cutoff relative to input sampling frequency
+	int c = L / 2;
+	float *tmp = (float *)malloc((L)*sizeof(float));
+	float sum = 0.0;
+	for (int k = 0; k < L; k++) {
+		float t = (float)(k - c);
+		float sinc = (k == c) ? 2.0 * fc : sin(2.0 * PI * fc * t) / (PI * t);
+		float w = 0.5 - 0.5 * cos(2.0 * PI * (float)k / (float)(L - 1));
+		tmp[k] = sinc * w;
+		sum += tmp[k];
+	}
+	int32_t q_sum = 0;
+	for (int k = 0; k < L; k++) {
+		h[k] = (int16_t)lroundf(tmp[k] / sum * 32768.0);
+		q_sum += h[k];
+	}
+	h[c] += (int16_t)(32768 - q_sum); //DC gain correction
+	free(tmp);
+
+	Init();
+}
+#pragma endregion
+
+#pragma region void Decimator::Init()
+/* Initialization
+Input: /
+Output: /
+Description: reset ring and counters
+*/
+void Decimator::Init() {
+	for (int i = 0; i < L; i++) {
+		delay[i] = 0;
+	}
+	pos = 0;
+	count = 0;
+	started = false;
+	dt_sum = 0.0;
+	dt_out = 0.0;
+	y = 0;
+}
+#pragma endregion
+
+#pragma region bool Decimator::AddElement(int16_t _x, float _dt)
+/* Add new sample
+Input: int16_t _x - new acceleration, float _dt - new time interval
+Output: bool - true when a new decimated sample is ready
+Description:
+* Fill the ring with the first sample, which avoids a start-up step
+* Store sample into the ring
+* Every M-th sample calculate FIR output over the ring - oldest sample is at the next position
+*/
+bool Decimator::AddElement(int16_t _x, float _dt) {
+
+	if (!started) {
+		for (int i = 0; i < L; i++) {
+			delay[i] = _x;
+		}
+		started = true;
+	}
+	delay[pos] = _x;
+	pos = (pos == L - 1) ? 0 : pos + 1;
+	dt_sum += _dt;
+
+	if (++count < M) {
+		return false;
+	}
+
+	//FIR over the ring in two parts, without modulo
+	int32_t acc = 0;
+	int k = 0;
+	for (int i = pos; i < L; i++) {
+		acc += (int32_t)h[k++] * delay[i];
+	}
+	for (int i = 0; i < pos; i++) {
+		acc += (int32_t)h[k++] * delay[i];
+	}
+	acc = (acc + (1L << 14)) >> 15;
+	y = (int16_t)max(-32768L, min(32767L, (long)acc));
+
+	dt_out = dt_sum;
+	dt_sum = 0.0;
+	count = 0;
+	return true;
+}
+#pragma endregion
+
+// GET FUNCTIONS
+
+int16_t Decimator::getElement() {
+	return y;
+}
+
+float Decimator::getDt() {
+	return dt_out;
+}
+
+int Decimator::getFactor() {
+	return M;
+}
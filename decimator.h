@@ -0,0 +1,40 @@
+/* DECIMATOR class - anti-alias filter and downsampling used in the wave_analyser.h library
+* Acceleration is low-pass filtered with a Hann windowed sinc FIR in Q15 and only every factor-th output is calculated,
+* so the cost per input sample is taps / factor multiplications. Cutoff is at 2/3 of the output Nyquist frequency,
+* e.g. 1.33 Hz for 100 Hz input and factor 25 - the wave band below 0.5 Hz is flat and aliases are attenuated by 50 dB.
+*/
+
+#ifndef _DECIMATOR_H_
+#define _DECIMATOR_H_
+
+#include <Arduino.h>
+
+#define DECIMATION_TAPS 8 //FIR length per unit of decimation factor
+
+class Decimator {
+public:
+
+	Decimator(int factor); //Constructor
+	void Init(); //Initialization
+	bool AddElement(int16_t _x, float _dt); //Add new sample - return true when a new decimated sample is ready
+
+	int16_t getElement(); //Last decimated sample
+	float getDt(); //Time interval of the last decimated sample
+	int getFactor(); //Decimation factor
+
+private:
+
+	int M; //Decimation factor
+	int L; //Number of taps
+	int16_t *h; //Q15 coefficients
+	int16_t *delay; //Ring of last L input samples
+
+	int pos = 0; //Position of next input in the ring
+	int count = 0; //Number of inputs since last output
+	bool started = false; //Denotes if the ring was filled with the first sample
+	float dt_sum = 0.0; //Sum of time intervals since last output
+	float dt_out = 0.0; //Time interval of the last output
+	int16_t y = 0; //Last output
+};
+
+#endif
@@ -0,0 +1,255 @@
+#include "directional_spectrum.h"
+
+#pragma region DirectionalSpectrum::DirectionalSpectrum(int segment, int decimation, float f_min, float f_max)
+/* DirectionalSpectrum constructor
+Input: int segment - segment length, power of 2, int decimation - decimation factor,
+       float f_min, float f_max - frequency band used for directional parameters
+Description: allocate segment, overlap and spectrum arrays. Number of bins is known only after sampling time is measured,
+so spectra are allocated for the full half segment and only bins up to f_max are used.
+*/
+DirectionalSpectrum::DirectionalSpectrum(int segment_length, int decimation, float f_min, float f_max) {
+
+	N_segment = segment_length;
+	N_decimation = decimation;
+	F_min = f_min;
+	F_max = f_max;
+	N_bins = N_segment / 2;
+
+	for (int c = 0; c < DIRECTIONAL_CHANNELS; c++) {
+		segment[c] = (int16_t *)malloc((N_segment)*sizeof(int16_t));
+		overlap[c] = (int16_t *)malloc((N_segment / 2)*sizeof(int16_t));
+	}
+	c_zz = (float *)malloc((N_bins)*sizeof(float));
+	c_hh = (float *)malloc((N_bins)*sizeof(float));
+	q_ze = (float *)malloc((N_bins)*sizeof(float));
+	q_zn = (float *)malloc((N_bins)*sizeof(float));
+
+	Init();
+}
+#pragma endregion
+
+#pragma region void DirectionalSpectrum::Init()
+/* Initialization
+Input: /
+Output: /
+Description: reset accumulated spectra, counters and results
+*/
+void DirectionalSpectrum::Init() {
+	for (int i = 0; i < N_bins; i++) {
+		c_zz[i] = 0.0;
+		c_hh[i] = 0.0;
+		q_ze[i] = 0.0;
+		q_zn[i] = 0.0;
+	}
+	for (int c = 0; c < DIRECTIONAL_CHANNELS; c++) {
+		dec_sum[c] = 0;
+	}
+	dec_count = 0;
+	fill = 0;
+	segments = 0;
+	n_elements = 0;
+	dt_sum = 0.0;
+	mean_direction = 0.0;
+	peak_direction = 0.0;
+	spread = 0.0;
+}
+#pragma endregion
+
+#pragma region bool DirectionalSpectrum::AddElement(int16_t east, int16_t north, int16_t up, float _dt)
+/* Add new element
+Input: int16_t east, int16_t north, int16_t up - new earth-frame accelerations in mg, float _dt - new time interval
+Output: bool - true when a segment was transformed
+Description:
+* Average N_decimation samples of each channel into one segment sample
+* The first segments are collected whole, later segments need only half of new samples
+* When the segments are full, store their second halves as overlap for the next ones and transform them
+*/
+bool DirectionalSpectrum::AddElement(int16_t east, int16_t north, int16_t up, float _dt) {
+
+	n_elements++;
+	dt_sum += _dt;
+	dec_sum[0] += east;
+	dec_sum[1] += north;
+	dec_sum[2] += up;
+	dec_count++;
+	if (dec_count < N_decimation) {
+		return false;
+	}
+
+	int half = N_segment / 2;
+	int idx = (segments == 0) ? fill : half + fill;
+	for (int c = 0; c < DIRECTIONAL_CHANNELS; c++) {
+		segment[c][idx] = (int16_t)(dec_sum[c] / N_decimation);
+		dec_sum[c] = 0;
+	}
+	dec_count = 0;
+	fill++;
+
+	if (fill < ((segments == 0) ? N_segment : half)) {
+		return false;
+	}
+
+	for (int c = 0; c < DIRECTIONAL_CHANNELS; c++) {
+		for (int i = 0; i < half; i++) {
+			int16_t tmp = overlap[c][i];
+			overlap[c][i] = segment[c][half + i];
+			if (segments > 0) {
+				segment[c][i] = tmp;
+			}
+		}
+	}
+	fill = 0;
+	transform();
+	return true;
+}
+#pragma endregion
+
+#pragma region void DirectionalSpectrum::transform()
+/* Transform segments
+Input: /
+Output: /
+Description:
+* Remove mean value and apply Hann window to each channel
+* Scale to full Q15 range and calculate real FFT in place, each channel has its own block exponent
+* Update running averages of vertical and horizontal auto-spectra and vertical-horizontal quad-spectra
+  Q(z, x) = Im(Z conj(X)). Common scale factors cancel in the directional parameters and are left out.
+*/
+void DirectionalSpectrum::transform() {
+
+	int exponent[DIRECTIONAL_CHANNELS];
+	for (int c = 0; c < DIRECTIONAL_CHANNELS; c++) {
+		int16_t *x = segment[c];
+
+		int32_t sum = 0;
+		for (int i = 0; i < N_segment; i++) {
+			sum += x[i];
+		}
+		int16_t mean = (int16_t)(sum / N_segment);
+
+		for (int i = 0; i < N_segment; i++) {
+			int16_t w = (int16_t)((32767 - FixedFFT::Cos(i, N_segment)) >> 1);
+			x[i] = FixedFFT::Multiply(x[i] - mean, w);
+		}
+
+		exponent[c] = FixedFFT::Normalize(x, N_segment);
+		exponent[c] += FixedFFT::Real(x, N_segment);
+	}
+
+	float scale_zz = ldexpf(1.0, 2 * exponent[2]);
+	float scale_ee = ldexpf(1.0, 2 * exponent[0]);
+	float scale_nn = ldexpf(1.0, 2 * exponent[1]);
+	float scale_ze = ldexpf(1.0, exponent[2] + exponent[0]);
+	float scale_zn = ldexpf(1.0, exponent[2] + exponent[1]);
+	float df = getDf();
+
+	for (int k = 1; k < N_bins && (float)k * df <= F_max; k++) {
+		float er = (float)segment[0][2 * k], ei = (float)segment[0][2 * k + 1];
+		float nr = (float)segment[1][2 * k], ni = (float)segment[1][2 * k + 1];
+		float zr = (float)segment[2][2 * k], zi = (float)segment[2][2 * k + 1];
+		float w = 1.0 / (float)(segments + 1);
+
+		c_zz[k] += ((zr * zr + zi * zi) * scale_zz - c_zz[k]) * w;
+		c_hh[k] += ((er * er + ei * ei) * scale_ee + (nr * nr + ni * ni) * scale_nn - c_hh[k]) * w;
+		q_ze[k] += ((zi * er - zr * ei) * scale_ze - q_ze[k]) * w;
+		q_zn[k] += ((zi * nr - zr * ni) * scale_zn - q_zn[k]) * w;
+	}
+	segments++;
+	LOG(2, "Directional segment: %d", segments);
+}
+#pragma endregion
+
+#pragma region bool DirectionalSpectrum::Analyse()
+/* Calculate directional parameters
+Input: /
+Output: bool - true if the parameters were calculated
+Description:
+* Calculate a1 and b1 of each bin in the frequency band
+* Heave density C(up, up) / (2 PI f)^4 weights the mean a1, b1 and determines the peak bin
+* Mean direction from mean a1, b1, spread sqrt(2 (1 - r1)) with r1 = sqrt(a1^2 + b1^2)
+* Peak direction from a1, b1 of the peak bin
+*/
+bool DirectionalSpectrum::Analyse() {
+
+	float df = getDf();
+	if (segments == 0 || df <= 0.0) {
+		return false;
+	}
+
+	float e_sum = 0.0, a_sum = 0.0, b_sum = 0.0;
+	float e_peak = 0.0;
+	for (int k = 1; k < N_bins && (float)k * df <= F_max; k++) {
+		float f = (float)k * df;
+		float d = sqrt(c_zz[k] * c_hh[k]);
+		if (f < F_min || d <= 0.0) {
+			continue;
+		}
+		float a1 = q_ze[k] / d;
+		float b1 = q_zn[k] / d;
+		float w = 2.0 * PI * f;
+		float e = c_zz[k] / (w * w * w * w);
+
+		e_sum += e;
+		a_sum += a1 * e;
+		b_sum += b1 * e;
+		if (e > e_peak) {
+			e_peak = e;
+			peak_direction = toNautical(a1, b1);
+		}
+	}
+	if (e_sum <= 0.0) {
+		return false;
+	}
+
+	float a1 = a_sum / e_sum;
+	float b1 = b_sum / e_sum;
+	float r1 = min(1.0f, (float)sqrt(a1 * a1 + b1 * b1));
+	mean_direction = toNautical(a1, b1);
+	spread = sqrt(2.0 * (1.0 - r1)) * 180.0 / PI;
+
+	LOG(1, "DIRECTIONAL: segments %d, r1 %d", segments, (int)(r1 * 100));
+	return true;
+}
+#pragma endregion
+
+#pragma region float DirectionalSpectrum::toNautical(float a1, float b1)
+/* Convert direction of propagation to nautical direction
+Input: float a1, float b1 - east and north component of direction of propagation
+Output: float - direction waves come from, degrees clockwise from north between 0 and 360
+*/
+float DirectionalSpectrum::toNautical(float a1, float b1) {
+	float direction = 270.0 - atan2(b1, a1) * 180.0 / PI;
+	if (direction >= 360.0) {
+		direction -= 360.0;
+	}
+	return direction;
+}
+#pragma endregion
+
+// GET FUNCTIONS
+
+float DirectionalSpectrum::getDf() {
+	if (n_elements == 0) {
+		return 0.0;
+	}
+	return 1.0 / ((float)N_segment * (float)N_decimation * dt_sum / (float)n_elements);
+}
+
+float DirectionalSpectrum::getMeanDirection() {
+	return mean_direction;
+}
+
+float DirectionalSpectrum::getPeakDirection() {
+	return peak_direction;
+}
+
+float DirectionalSpectrum::getSpread() {
+	return spread;
+}
+
+int DirectionalSpectrum::getSegments() {
+	return segments;
+}
+
+float DirectionalSpectrum::getTime() {
+	return dt_sum;
+}
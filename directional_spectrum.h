@@ -0,0 +1,67 @@
+/* DIRECTIONAL SPECTRUM class - directional wave parameters used in the wave_analyser.h library
+* Earth-frame east, north and up accelerations are block-averaged to a lower rate and split into Hann windowed
+* segments with 50 % overlap, as in welch_psd.h. Each channel is transformed with the fixed point FFT and the auto-,
+* co- and quad-spectra are accumulated during acquisition. Horizontal and vertical motion of a wave are in quadrature,
+* so the first directional Fourier coefficients of each bin are:
+* a1 = Q(up, east) / sqrt(C(up, up) (C(east, east) + C(north, north))), b1 = Q(up, north) / sqrt(...)
+* Mean direction and spread are calculated from a1, b1 averaged with the heave density, peak direction from a1, b1
+* of the heave spectrum peak. Directions are nautical - where waves come from, in degrees clockwise from north.
+*/
+
+#ifndef _DIRECTIONAL_SPECTRUM_H_
+#define _DIRECTIONAL_SPECTRUM_H_
+
+#include <Arduino.h>
+#include "fixed_fft.h" //Q15 FFT
+#include "welch_psd.h" //Segment length and decimation defaults
+#include "wave_spectrum.h" //Frequency band of spectral parameters
+
+#define DIRECTIONAL_CHANNELS 3 //East, north and up acceleration
+
+class DirectionalSpectrum {
+public:
+
+	DirectionalSpectrum(int segment = WELCH_SEGMENT, int decimation = WELCH_DECIMATION, float f_min = SPECTRUM_F_MIN,
+		float f_max = SPECTRUM_F_MAX); //Constructor
+	void Init(); //Initialization
+	bool AddElement(int16_t east, int16_t north, int16_t up, float _dt); //Add new accelerations in mg - return true when a segment was transformed
+	bool Analyse(); //Calculate directional parameters from accumulated spectra
+
+	float getMeanDirection(); //Mean wave direction in degrees
+	float getPeakDirection(); //Wave direction at the spectral peak in degrees
+	float getSpread(); //Mean directional spread in degrees
+	int getSegments(); //Number of averaged segments
+	float getTime(); //Duration of added data in s
+
+private:
+
+	int N_segment; //Segment length
+	int N_decimation; //Decimation factor
+	int N_bins; //Number of stored bins
+
+	int16_t *segment[DIRECTIONAL_CHANNELS]; //Segment buffers - transformed in place
+	int16_t *overlap[DIRECTIONAL_CHANNELS]; //Second halves of previous segments
+	float *c_zz; //Running average of vertical auto-spectrum
+	float *c_hh; //Running average of sum of horizontal auto-spectra
+	float *q_ze; //Running average of vertical-east quad-spectrum
+	float *q_zn; //Running average of vertical-north quad-spectrum
+
+	int32_t dec_sum[DIRECTIONAL_CHANNELS]; //Sums of samples for block averaging
+	int dec_count = 0; //Number of samples in the current block
+	int fill = 0; //Number of new samples in the segments
+	int segments = 0; //Number of transformed segments
+	long n_elements = 0; //Number of added samples
+	float dt_sum = 0.0; //Sum of time intervals
+	float F_min; //Frequency band of directional parameters
+	float F_max;
+
+	float mean_direction = 0.0; //Results
+	float peak_direction = 0.0;
+	float spread = 0.0;
+
+	void transform(); //Window, transform and accumulate full segments
+	float getDf(); //Bin width in Hz
+	float toNautical(float a1, float b1); //Convert direction of propagation to nautical direction
+};
+
+#endif
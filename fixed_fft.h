@@ -0,0 +1,34 @@
+/* FIXED FFT class - radix-2 FFT in Q15 fixed point, used in the wave_spectrum.h library
+* Data is stored as int16_t, products are calculated in 32-bit integers (Q31) and rounded back to Q15.
+* Block floating point is used - a stage is scaled by 1/2 only when it could overflow, the number of shifts is returned
+* as the block exponent, so that true result = output * 2^exponent.
+* No FPU is needed, twiddle factors are read from a quarter-wave sine table.
+*/
+
+#ifndef _FIXED_FFT_H_
+#define _FIXED_FFT_H_
+
+#include <Arduino.h>
+
+#define FFT_MAX_LOG2 12 //Max real FFT length 4096
+#define FFT_MAX (1 << FFT_MAX_LOG2)
+#define FFT_HEADROOM 13573 //Max absolute value before butterfly that can not overflow: 32768 / (1 + sqrt(2))
+#define HANN_POWER 0.375 //Mean square value of the Hann window
+
+class FixedFFT {
+public:
+	static int Complex(int16_t *z, int n); //In-place complex FFT of n interleaved re/im values, return block exponent
+	static int Real(int16_t *x, int n); //In-place real FFT of n samples in packed format, return block exponent
+	static int RealInverse(int16_t *x, int n); //In-place inverse of Real, return block exponent including 1/n
+	static int Normalize(int16_t *x, int n); //Scale up data to use full Q15 range, return block exponent
+	static int16_t Sin(long i, long n); //sin(2 * PI * i / n) in Q15
+	static int16_t Cos(long i, long n); //cos(2 * PI * i / n) in Q15
+	static int16_t Multiply(int16_t a, int16_t b); //Q15 multiplication with rounding
+
+private:
+	static int32_t MaxAbs(int16_t *x, int n);
+	static void Shift(int16_t *x, int n);
+	static int32_t Half(int32_t v);
+};
+
+#endif
@@ -0,0 +1,113 @@
+/* FIXED POINT class - signed 32-bit fixed-point scalar used in the array_structures.h and ahrs.h libraries
+* Fixed<F> holds a value as an int32_t with F fractional bits, e.g. Fixed<16> is Q16.16 and Fixed<30> is Q1.30.
+* Products are calculated in 64 bits and rounded, so a multiplication is one integer multiply and a shift instead of a
+* soft-float call on a core without FPU. Operators with int constants are exact and cheap, so generic code should use
+* int constants (2 * x, x / 2) instead of float ones. Values are not saturated - choose F for the range of the data.
+* Sqrt and InvSqrt are overloaded for float and Fixed, so templated code can call them for any scalar type.
+*/
+
+#ifndef _FIXED_POINT_H_
+#define _FIXED_POINT_H_
+
+#include <Arduino.h>
+#include <math.h>
+
+#define FIXED_NEWTON 4 //Newton iterations of the inverse square root
+
+template <int F>
+class Fixed {
+public:
+
+	int32_t v; //Raw value, v / 2^F
+
+	Fixed() : v(0) {}
+	Fixed(int x) : v((int32_t)x << F) {}
+	Fixed(float x) : v((int32_t)lroundf(x * (float)(1L << F))) {}
+
+	static Fixed raw(int32_t r) { Fixed f; f.v = r; return f; } //From raw value
+	float toFloat() const { return (float)v / (float)(1L << F); }
+
+	Fixed operator-() const { return raw(-v); }
+	Fixed operator+(Fixed b) const { return raw(v + b.v); }
+	Fixed operator-(Fixed b) const { return raw(v - b.v); }
+	Fixed operator*(Fixed b) const { return raw((int32_t)(((int64_t)v * b.v + (1LL << (F - 1))) >> F)); }
+	Fixed operator+(int b) const { return raw(v + ((int32_t)b << F)); }
+	Fixed operator-(int b) const { return raw(v - ((int32_t)b << F)); }
+	Fixed operator*(int b) const { return raw(v * b); }
+	Fixed operator/(int b) const { return raw(v / b); }
+
+	Fixed &operator+=(Fixed b) { v += b.v; return *this; }
+	Fixed &operator-=(Fixed b) { v -= b.v; return *this; }
+	Fixed &operator*=(Fixed b) { *this = *this * b; return *this; }
+
+	bool operator==(Fixed b) const { return v == b.v; }
+	bool operator!=(Fixed b) const { return v != b.v; }
+	bool operator<(Fixed b) const { return v < b.v; }
+	bool operator>(Fixed b) const { return v > b.v; }
+	bool operator<=(Fixed b) const { return v <= b.v; }
+	bool operator>=(Fixed b) const { return v >= b.v; }
+};
+
+template <int F> inline Fixed<F> operator+(int a, Fixed<F> b) { return b + a; }
+template <int F> inline Fixed<F> operator-(int a, Fixed<F> b) { return Fixed<F>::raw(((int32_t)a << F) - b.v); }
+template <int F> inline Fixed<F> operator*(int a, Fixed<F> b) { return b * a; }
+
+#pragma region InvSqrt(Fixed<F> x)
+/* Inverse square root
+Input: Fixed<F> x - positive value, F must be even
+Output: Fixed<F> - 1 / sqrt(x), 0 for x <= 0, saturated if too large for the format
+Description:
+* Shift the raw value by an even number of bits to a mantissa m in [0.25, 1) as unsigned Q0.32, so
+  x = m 2^(32 - F - s) and 1 / sqrt(x) = 1 / sqrt(m) 2^(-(32 - F - s) / 2)
+* Start from the chord 7/3 - 4/3 m of 1 / sqrt(m), error below 19 %
+* Newton iterations y = y (3 - m y^2) / 2 in Q2.30 - the error is squared each time, 4 iterations reach 32-bit precision
+* Shift the result back to F fractional bits
+*/
+template <int F>
+Fixed<F> InvSqrt(Fixed<F> x) {
+	if (x.v <= 0) {
+		return Fixed<F>::raw(0);
+	}
+	int s = __builtin_clz((uint32_t)x.v) & ~1;
+	uint64_t m = (uint64_t)((uint32_t)x.v << s); //Q0.32
+	int64_t y = ((7LL << 30) - (int64_t)m) / 3; //Q2.30 - 4/3 m in Q2.30 is m / 3 in Q0.32 units
+	for (int i = 0; i < FIXED_NEWTON; i++) {
+		int64_t y2 = (y * y) >> 30; //Q2.30
+		int64_t t = (3LL << 30) - (int64_t)((m * (uint64_t)y2) >> 32);
+		y = (y * t) >> 31;
+	}
+
+	int shift = F - 30 - (32 - F - s) / 2;
+	if (shift >= 0) {
+		if (y >= ((int64_t)1 << (31 - shift))) {
+			return Fixed<F>::raw(INT32_MAX);
+		}
+		return Fixed<F>::raw((int32_t)(y << shift));
+	}
+	return Fixed<F>::raw((int32_t)((y + ((int64_t)1 << (-shift - 1))) >> -shift));
+}
+#pragma endregion
+
+template <int F>
+Fixed<F> Sqrt(Fixed<F> x) {
+	return x * InvSqrt(x);
+}
+
+inline float InvSqrt(float x) {
+	return 1.0f / sqrtf(x);
+}
+
+inline float Sqrt(float x) {
+	return sqrtf(x);
+}
+
+inline float toFloat(float x) {
+	return x;
+}
+
+template <int F>
+float toFloat(Fixed<F> x) {
+	return x.toFloat();
+}
+
+#endif
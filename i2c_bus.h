@@ -0,0 +1,35 @@
+/* I2C BUS interface - TwoWire-like bus used by the i2c_queue.h library
+* I2CQueue talks to the bus only through this interface, so it runs on the Arduino Wire library (wire_bus.h) as well as
+* on a scripted fake in host tests. Blocking calls follow TwoWire. A bus with asynchronous transfers returns true from
+* isAsync() and implements transfer() - at the end of the transfer it writes the status and calls the callback,
+* usually from interrupt.
+*/
+
+#ifndef _I2C_BUS_H_
+#define _I2C_BUS_H_
+
+#include <Arduino.h>
+
+typedef void (*I2CTransferCallback)(); //End of asynchronous transfer
+
+class I2CBus {
+public:
+
+	virtual void beginTransmission(uint8_t address) = 0; //Start write to slave
+	virtual size_t write(const uint8_t *data, size_t size) = 0; //Put data in Tx buffer
+	virtual uint8_t endTransmission(bool stop) = 0; //Send Tx buffer, return Wire error code
+	virtual uint8_t requestFrom(uint8_t address, uint8_t size) = 0; //Read from slave, return number of bytes read
+	virtual int available() = 0; //Number of bytes left in Rx buffer
+	virtual int read() = 0; //Next byte of Rx buffer
+
+	virtual bool isAsync() { return false; } //Are asynchronous transfers supported
+
+	/* Asynchronous write of tx followed by a repeated start and read of rx_size bytes into rx (no read if rx_size is 0).
+	Return false if the bus refuses the transfer, e.g. while it is busy. */
+	virtual bool transfer(uint8_t address, uint8_t *tx, uint8_t tx_size, uint8_t *rx, uint8_t rx_size, volatile uint8_t *status,
+		I2CTransferCallback callback) {
+		return false;
+	}
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "i2c_queue.h"
+
+I2CQueue *I2CQueue::instance = NULL;
+
+#pragma region I2CQueue::I2CQueue(I2CBus *bus)
+/* I2CQueue constructor
+Input: I2CBus *bus - I2C bus, e.g. WireBus started with Wire.begin()
+*/
+I2CQueue::I2CQueue(I2CBus *_bus) {
+	bus = _bus;
+	Init();
+}
+#pragma endregion
+
+#pragma region void I2CQueue::Init()
+/* Initialization
+Input: /
+Output: /
+Description: drop queued transactions, a transfer in progress is finished by the bus but its callback is not called
+*/
+void I2CQueue::Init() {
+	head = 0;
+	tail = 0;
+	active = false;
+	done = false;
+	status = I2C_OK;
+}
+#pragma endregion
+
+#pragma region bool I2CQueue::Read(uint8_t address, uint8_t reg, uint8_t *dest, uint8_t count, I2CCallback callback, void *context)
+/* Queue register read
+Input: uint8_t address - slave address, uint8_t reg - first register, uint8_t *dest - uint8_t[count] array to store
+       read data, must stay valid until completion, uint8_t count - number of bytes, I2CCallback callback, void *context
+Output: bool - false if the queue is full
+Description: write register address, repeated start and read count bytes
+*/
+bool I2CQueue::Read(uint8_t address, uint8_t reg, uint8_t *dest, uint8_t count, I2CCallback callback, void *context) {
+	I2CTransaction t;
+	t.address = address;
+	t.tx[0] = reg;
+	t.tx_size = 1;
+	t.rx = dest;
+	t.rx_size = count;
+	t.callback = callback;
+	t.context = context;
+	return push(&t);
+}
+#pragma endregion
+
+#pragma region bool I2CQueue::Write(uint8_t address, uint8_t reg, uint8_t data, I2CCallback callback, void *context)
+/* Queue register write
+Input: uint8_t address - slave address, uint8_t reg - register, uint8_t data - value, I2CCallback callback, void *context
+Output: bool - false if the queue is full
+*/
+bool I2CQueue::Write(uint8_t address, uint8_t reg, uint8_t data, I2CCallback callback, void *context) {
+	I2CTransaction t;
+	t.address = address;
+	t.tx[0] = reg;
+	t.tx[1] = data;
+	t.tx_size = 2;
+	t.rx = NULL;
+	t.rx_size = 0;
+	t.callback = callback;
+	t.context = context;
+	return push(&t);
+}
+#pragma endregion
+
+#pragma region void I2CQueue::Poll()
+/* Process the queue
+Input: /
+Output: /
+Description:
+* If the transfer in progress is finished, remove it from the queue and call its callback with its status
+* If the bus is free, start the next queued transaction
+*/
+void I2CQueue::Poll() {
+	if (active && done) {
+		I2CTransaction *t = &queue[tail];
+		tail = (tail + 1) & (I2C_QUEUE_SIZE - 1);
+		active = false;
+		if (t->callback) {
+			t->callback(t->context, status);
+		}
+	}
+	if (!active && tail != head) {
+		start();
+	}
+}
+#pragma endregion
+
+bool I2CQueue::isBusy() {
+	return active || tail != head;
+}
+
+/* PRIVATE METHODS */
+
+#pragma region bool I2CQueue::push(I2CTransaction *t)
+/* Add transaction to the ring
+Input: I2CTransaction *t - transaction, copied into the ring
+Output: bool - false if the queue is full
+*/
+bool I2CQueue::push(I2CTransaction *t) {
+	uint8_t next = (head + 1) & (I2C_QUEUE_SIZE - 1);
+	if (next == tail) {
+		return false;
+	}
+	queue[head] = *t;
+	head = next;
+	return true;
+}
+#pragma endregion
+
+#pragma region void I2CQueue::start()
+/* Start oldest transaction
+Input: /
+Output: /
+Description:
+* Asynchronous bus - hand the transaction to the bus transfer, onTransfer() is called from interrupt at its end.
+  If the bus refuses it, it is retried on the next Poll().
+* Otherwise execute the transaction with blocking calls, it is finished when this returns
+*/
+void I2CQueue::start() {
+	I2CTransaction *t = &queue[tail];
+	done = false;
+	status = I2C_OK;
+
+	if (bus->isAsync()) {
+		instance = this;
+		active = bus->transfer(t->address, t->tx, t->tx_size, t->rx, t->rx_size, &status, I2CQueue::onTransfer);
+		return;
+	}
+
+	active = true;
+	bus->beginTransmission(t->address);
+	bus->write(t->tx, t->tx_size);
+	if (t->rx_size == 0) {
+		status = bus->endTransmission(true);
+	}
+	else {
+		status = bus->endTransmission(false);
+		uint8_t i = 0;
+		bus->requestFrom(t->address, t->rx_size);
+		while (bus->available() && i < t->rx_size) {
+			t->rx[i++] = bus->read();
+		}
+		if (i < t->rx_size && status == I2C_OK) {
+			status = I2C_INCOMPLETE;
+		}
+	}
+	done = true;
+}
+#pragma endregion
+
+#pragma region void I2CQueue::onTransfer()
+/* End of transfer callback
+Input: /
+Output: /
+Description: called from interrupt, only marks the transfer as finished - the status was already written by the bus
+*/
+void I2CQueue::onTransfer() {
+	if (instance) {
+		instance->done = true;
+	}
+}
+#pragma endregion
@@ -0,0 +1,60 @@
+/* I2C QUEUE class - non-blocking register transactions used in the MPU9250.h library and the main sketch
+* Register reads and writes are queued as descriptors and executed one after another, so a burst can move while the
+* main loop computes. The bus is an injected I2CBus (i2c_bus.h), WireBus on the Arduino Wire library. If the bus has
+* asynchronous transfers (STM32L0 core) the end of a transfer is signalled from interrupt, otherwise a transaction is
+* executed with blocking calls when it is started. Completion callbacks are always called from Poll() in the main loop,
+* never from interrupt, so they can safely touch driver state. Only one transfer is in progress over all queues.
+*/
+
+#ifndef _I2C_QUEUE_H_
+#define _I2C_QUEUE_H_
+
+#include <Arduino.h>
+#include "i2c_bus.h" //Bus interface
+
+#define I2C_QUEUE_SIZE 8 //Number of queued transactions, power of 2
+
+#define I2C_OK 0 //Transaction status - otherwise Wire error code
+#define I2C_INCOMPLETE 4 //Fewer bytes read than requested
+
+typedef void (*I2CCallback)(void *context, uint8_t status); //Completion callback
+
+struct I2CTransaction {
+	uint8_t address; //Slave address
+	uint8_t tx[2]; //Register and data to write
+	uint8_t tx_size; //1 for read, 2 for write
+	uint8_t *rx; //Destination of read data - NULL for write
+	uint8_t rx_size; //Number of bytes to read
+	I2CCallback callback; //Called on completion - can be NULL
+	void *context; //Passed to the callback
+};
+
+class I2CQueue {
+public:
+
+	I2CQueue(I2CBus *bus); //Constructor
+	void Init(); //Initialization - drop queued transactions
+	bool Read(uint8_t address, uint8_t reg, uint8_t *dest, uint8_t count, I2CCallback callback = NULL, void *context = NULL); //Queue register read
+	bool Write(uint8_t address, uint8_t reg, uint8_t data, I2CCallback callback = NULL, void *context = NULL); //Queue register write
+	void Poll(); //Finish transfer, call its callback and start next one - call from the main loop
+
+	bool isBusy(); //Is a transaction queued or in progress
+
+private:
+
+	I2CBus *bus; //I2C bus
+	I2CTransaction queue[I2C_QUEUE_SIZE]; //Ring of transactions
+	uint8_t head = 0; //Next free slot
+	uint8_t tail = 0; //Oldest transaction
+	bool active = false; //Oldest transaction was started
+	volatile bool done = false; //Oldest transaction was finished - set from interrupt
+	volatile uint8_t status = I2C_OK; //Status of the finished transaction
+
+	static I2CQueue *instance; //Queue of the transfer in progress, for the interrupt callback
+	static void onTransfer(); //End of transfer interrupt callback
+
+	bool push(I2CTransaction *t); //Add transaction to the ring
+	void start(); //Start oldest transaction
+};
+
+#endif
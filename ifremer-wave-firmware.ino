@@ -13,7 +13,6 @@
  *  Cover corner-case of Join failures etc...
  *  
  *  INSTRUCTIONS:
- *  Install: https://github.com/MartinBloedorn/libFilter/tree/25a03b6cb83cfef17b9eee85eb34e807bd0ad135
  *  Edit Comms tab to enter LoraWAN details
  *  Upload
  *  
@@ -37,10 +36,22 @@
 #include "TimerMillis.h"
 #include <Wire.h>
 #include "wave_analyser.h"
+#include "wire_bus.h"
+#include "i2c_queue.h"
 
 #define sleep_period 1 // sleep duration in minutes
+//#define MPU_INT 7 // MCU pin wired to MPU9250 INT - enables interrupt driven acquisition
+//#define CONTINUOUS 0.5 // overlap of analysis windows - enables continuous acquisition for mains or solar power
+#define report_period 5 // uplink period in minutes in continuous mode - windows are analysed every 15 s in between
 
 TimerMillis wdtTimer; //timer for transmission events
+TimerMillis reportTimer; //timer for uplinks in continuous mode
+volatile bool report_due = false; //uplink period has passed
+bool window_ready = false; //a window was analysed since the last uplink
+
+// Sensor sleep writes are queued, so they move while the MCU waits - the MPU9250 queue is idle after its own sleep
+WireBus sleepBus(&Wire);
+I2CQueue sleepQueue(&sleepBus);
 
 #define debug
 #define serial_debug  Serial1
@@ -64,10 +75,77 @@ void wave_setup( void ){
   waveAnalyser.setup();
   //waveAnalyser.setCalibrationDelay(1000); //Set new innitial calibration delay time in millis
   //waveAnalyser.setNumberOfWaves(5); //Set new number of waves to measure in each itteration, max wave number is 100
+  //waveAnalyser.setFifo(true); //Sample into the sensor FIFO and sleep between drains
+  //waveAnalyser.setMasterRead(true); //Read all nine axes with one I2C burst
+  //waveAnalyser.setAsync(true); //Read sensor in the background while analysing
+  //waveAnalyser.setIMU(true); //Six-axis fusion, magnetometer powered down for heave-only buoys
+  #ifdef MPU_INT
+    waveAnalyser.setInterrupt(true); //Read sensor on data-ready interrupt and sleep in between
+  #endif
 }
 
 bool update_wave( void ){
-  return waveAnalyser.update();
+  bool done = waveAnalyser.update();
+  unsigned long idle = waveAnalyser.getIdleTime();
+  if (!done && idle > 0) {
+    STM32L0.stop(idle); // sleep until the next FIFO drain
+  }
+  return done;
+}
+
+// wait for a sensor conversion - in continuous mode keep analysing, so the MPU9250 FIFO is drained meanwhile
+void sensors_wait(unsigned long wait) {
+  #ifdef CONTINUOUS
+    unsigned long start = millis();
+    while (millis() - start < wait) {
+      update_wave(); // a window finished here is the one being reported
+    }
+  #else
+    delay(wait);
+  #endif
+}
+
+#ifdef MPU_INT
+// MPU9250 data-ready ISR
+void ISR_MPU() {
+    waveAnalyser.dataReady();
+    STM32L0.wakeup();
+}
+#endif
+
+// report failed sleep write
+void sleep_write_done(void *context, uint8_t status) {
+  #ifdef debug
+    if (status != I2C_OK) {
+      serial_debug.print("Sleep write error: ");
+      serial_debug.println(status);
+    }
+  #endif
+}
+
+// poll the sleep queue for at least wait millis and until it is empty
+void sleep_queue_wait(unsigned long wait) {
+  unsigned long start = millis();
+  do {
+    sleepQueue.Poll();
+  } while (sleepQueue.isBusy() || millis() - start < wait);
+}
+
+// put MPU9250 and AK8963 to sleep
+void sensors_sleep( void ){
+  sleepQueue.Write(0x68, 0x6b, 0x3f, sleep_write_done); // sleep, all sensors disabled
+  sleep_queue_wait(100);
+  sleepQueue.Write(0x68, 0x6b, 0x48, sleep_write_done); // sleep, temperature sensor disabled
+  sleep_queue_wait(100);
+  sleepQueue.Write(0x0C, 0x0A, 0x00, sleep_write_done); // AK8963 power down
+  sleepQueue.Write(0x68, 0x6b, 0x40, sleep_write_done); // sleep
+  sleep_queue_wait(0);
+}
+
+// report timer ISR
+void ISR_REPORT() {
+    report_due = true;
+    STM32L0.wakeup();
 }
 
 // watchdog timer ISR
@@ -85,11 +163,39 @@ void setup( void )
     //Functions setup
     comms_setup(); // LoraWAN communication
     sensors_setup(); // Sensor communication
+    #ifdef MPU_INT
+      pinMode(MPU_INT, INPUT);
+      attachInterrupt(digitalPinToInterrupt(MPU_INT), ISR_MPU, RISING);
+    #endif
 
     // Watchdog setup with kick every 15s and 18s timeout
     wdtTimer.start(ISR_WDT, 0, 15*1000);
     STM32L0.wdtEnable(18000);
+
+    #ifdef CONTINUOUS
+      // setup the wave measurement code once, the sensor keeps sampling into its FIFO
+      wave_setup();
+      waveAnalyser.setContinuous(CONTINUOUS);
+      waveAnalyser.setFifo(true);
+      reportTimer.start(ISR_REPORT, report_period*60*1000, report_period*60*1000);
+    #endif
+}
+
+#ifdef CONTINUOUS
+void loop( void )
+{
+  // analyse windows without sensor power-down and sleep, send the results of the latest one every report_period
+  if (update_wave()) {
+    window_ready = true;
+  }
+  if (report_due && window_ready) {
+    report_due = false;
+    window_ready = false;
+    read_sensors();
+    comms_transmit();
+  }
 }
+#else
 void loop( void )
 {
   // setup the wave measurement code
@@ -110,27 +216,11 @@ void loop( void )
     serial_debug.flush();
   #endif
 
-  Wire.beginTransmission(0x68);
-  Wire.write(0x6b);
-  Wire.write(0x3f);
-  Wire.endTransmission();
-  delay(100);
-  Wire.beginTransmission(0x68);
-  Wire.write(0x6b);
-  Wire.write(0x48);
-  Wire.endTransmission();
-  delay(100);
-  Wire.beginTransmission(0x0C);
-  Wire.write(0x0A);
-  Wire.write(0x00);
-  Wire.endTransmission();
-  Wire.beginTransmission(0x68);
-  Wire.write(0x6b);
-  Wire.write(0x40);
-  Wire.endTransmission();
+  sensors_sleep();
 
   delay(5000);
 
   // sleep for a defined time
   STM32L0.stop(sleep_period*60*1000); // Enter STOP mode and wait for an interrupt
 }
+#endif
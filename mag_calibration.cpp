@@ -0,0 +1,174 @@
+#include "mag_calibration.h"
+
+#pragma region MagCalibration::MagCalibration()
+/* MagCalibration constructor */
+MagCalibration::MagCalibration() {
+	Init();
+}
+#pragma endregion
+
+#pragma region void MagCalibration::Init()
+/* Initialization
+Input: /
+Output: /
+Description: clear normal equations and counters
+*/
+void MagCalibration::Init() {
+	for (int i = 0; i < MAG_CAL_N; i++) {
+		for (int j = 0; j < MAG_CAL_N; j++) {
+			M[i][j] = 0.0f;
+		}
+		v[i] = 0.0f;
+	}
+	n = 0;
+	n_new = 0;
+	condition = 0.0f;
+}
+#pragma endregion
+
+#pragma region bool MagCalibration::AddSample(float x, float y, float z)
+/* Add sample
+Input: float x, float y, float z - uncalibrated magnetic field in mG
+Output: bool - true when enough samples were used and a new fit is due
+Description:
+	* Skip samples closer than MAG_CAL_MIN_STEP to the last used one
+	* Decay old statistics and add the outer product of the regressor [x^2, y^2, z^2, x, y, z] and the regressor itself
+*/
+bool MagCalibration::AddSample(float x, float y, float z) {
+	float dx = x - last[0], dy = y - last[1], dz = z - last[2];
+	if (n > 0 && dx * dx + dy * dy + dz * dz < MAG_CAL_MIN_STEP * MAG_CAL_MIN_STEP) {
+		return false;
+	}
+	last[0] = x;
+	last[1] = y;
+	last[2] = z;
+
+	x /= MAG_CAL_UNIT;
+	y /= MAG_CAL_UNIT;
+	z /= MAG_CAL_UNIT;
+	float p[MAG_CAL_N] = { x * x, y * y, z * z, x, y, z };
+	for (int i = 0; i < MAG_CAL_N; i++) {
+		for (int j = i; j < MAG_CAL_N; j++) {
+			M[i][j] = MAG_CAL_FORGET * M[i][j] + p[i] * p[j];
+		}
+		v[i] = MAG_CAL_FORGET * v[i] + p[i];
+	}
+
+	n++;
+	n_new++;
+	if (n < MAG_CAL_MIN_SAMPLES || n_new < MAG_CAL_SOLVE_PERIOD) {
+		return false;
+	}
+	n_new = 0;
+	return true;
+}
+#pragma endregion
+
+#pragma region bool MagCalibration::Solve(float *bias, float *scale)
+/* Fit ellipsoid
+Input: float *bias - float[3] hard-iron bias in mG, float *scale - float[3] soft-iron scale, both written only on success
+Output: bool - false if the fit is not well conditioned or the ellipsoid is not plausible
+Description:
+	* Scale the normal equations to unit diagonal, so the Cholesky pivots measure conditioning - a pivot close to 0
+	  means the samples do not cover enough directions to separate the parameters
+	* Solve by Cholesky decomposition and forward and back substitution
+	* Centre of the ellipsoid is the bias, G = 1 + A cx^2 + B cy^2 + C cz^2 and radius of each axis is sqrt(G / A)
+	* Scale is mean radius over axis radius
+*/
+bool MagCalibration::Solve(float *bias, float *scale) {
+	float L[MAG_CAL_N][MAG_CAL_N];
+	float d[MAG_CAL_N];
+	for (int i = 0; i < MAG_CAL_N; i++) {
+		if (M[i][i] <= 0.0f) {
+			condition = 0.0f;
+			return false;
+		}
+		d[i] = 1.0f / sqrtf(M[i][i]);
+	}
+
+	// Cholesky decomposition of D M D, lower triangle of L
+	condition = 1.0f;
+	for (int i = 0; i < MAG_CAL_N; i++) {
+		for (int j = 0; j <= i; j++) {
+			float sum = M[j][i] * d[i] * d[j];
+			for (int k = 0; k < j; k++) {
+				sum -= L[i][k] * L[j][k];
+			}
+			if (i == j) {
+				condition = min(condition, sum);
+				if (sum <= 0.0f) {
+					condition = 0.0f;
+					return false;
+				}
+				L[i][i] = sqrtf(sum);
+			}
+			else {
+				L[i][j] = sum / L[j][j];
+			}
+		}
+	}
+	if (condition < MAG_CAL_MIN_PIVOT) {
+		return false;
+	}
+
+	// Solve L L^T (p / D) = D v
+	float p[MAG_CAL_N];
+	for (int i = 0; i < MAG_CAL_N; i++) {
+		float sum = v[i] * d[i];
+		for (int k = 0; k < i; k++) {
+			sum -= L[i][k] * p[k];
+		}
+		p[i] = sum / L[i][i];
+	}
+	for (int i = MAG_CAL_N - 1; i >= 0; i--) {
+		float sum = p[i];
+		for (int k = i + 1; k < MAG_CAL_N; k++) {
+			sum -= L[k][i] * p[k];
+		}
+		p[i] = sum / L[i][i];
+	}
+	for (int i = 0; i < MAG_CAL_N; i++) {
+		p[i] *= d[i];
+	}
+
+	// Ellipsoid centre and radii
+	float c[3], r[3];
+	float G = 1.0f;
+	for (int i = 0; i < 3; i++) {
+		if (p[i] <= 0.0f) {
+			return false;
+		}
+		c[i] = -p[i + 3] / (2.0f * p[i]);
+		G += p[i] * c[i] * c[i];
+	}
+	float r_mean = 0.0f;
+	for (int i = 0; i < 3; i++) {
+		r[i] = sqrtf(G / p[i]) * MAG_CAL_UNIT;
+		if (r[i] < MAG_CAL_MIN_RADIUS || r[i] > MAG_CAL_MAX_RADIUS) {
+			return false;
+		}
+		r_mean += r[i] / 3.0f;
+	}
+	for (int i = 0; i < 3; i++) {
+		if (r_mean / r[i] > MAG_CAL_MAX_SCALE || r[i] / r_mean > MAG_CAL_MAX_SCALE) {
+			return false;
+		}
+	}
+
+	for (int i = 0; i < 3; i++) {
+		bias[i] = c[i] * MAG_CAL_UNIT;
+		scale[i] = r_mean / r[i];
+	}
+	return true;
+}
+#pragma endregion
+
+// GET FUNCTIONS
+
+int MagCalibration::getSamples() {
+	return n;
+}
+
+float MagCalibration::getCondition() {
+	return condition;
+}
@@ -0,0 +1,48 @@
+/* MAG CALIBRATION class - streaming hard- and soft-iron estimator used in the MPU9250.h library
+* Uncalibrated magnetometer samples lie on an axis-aligned ellipsoid A x^2 + B y^2 + C z^2 + D x + E y + F z = 1.
+* Each sample updates the 6x6 normal equations of its least-squares fit with exponential forgetting, so only the
+* sufficient statistics are kept and the fit follows slow changes of the surrounding iron. Samples closer than
+* MAG_CAL_MIN_STEP to the last used one are skipped, so a sensor at rest does not dominate the fit. The fit is solved
+* by Cholesky decomposition and accepted only when it is well conditioned and the ellipsoid is plausible - bias is its
+* centre and scale is the mean radius over the radius of each axis, the same model as magBias and magScale.
+*/
+
+#ifndef _MAG_CALIBRATION_H_
+#define _MAG_CALIBRATION_H_
+
+#include <Arduino.h>
+#include <math.h>
+
+#define MAG_CAL_N 6 //Number of ellipsoid parameters
+#define MAG_CAL_UNIT 1000.0f //Samples in mG are divided by this to keep the statistics near 1
+#define MAG_CAL_FORGET 0.999f //Forgetting factor per used sample
+#define MAG_CAL_MIN_STEP 20.0f //Min distance in mG from the last used sample
+#define MAG_CAL_MIN_SAMPLES 200 //Min used samples before the fit is solved
+#define MAG_CAL_SOLVE_PERIOD 50 //Used samples between fits
+#define MAG_CAL_MIN_PIVOT 1e-4f //Min normalised Cholesky pivot of a well conditioned fit
+#define MAG_CAL_MIN_RADIUS 150.0f //Plausible range of field strength in mG
+#define MAG_CAL_MAX_RADIUS 1000.0f
+#define MAG_CAL_MAX_SCALE 1.5f //Max scale correction of one axis
+
+class MagCalibration {
+public:
+
+	MagCalibration(); //Constructor
+	void Init(); //Initialization - forget all samples
+	bool AddSample(float x, float y, float z); //Add uncalibrated sample in mG, return true when a fit is due
+	bool Solve(float *bias, float *scale); //Fit ellipsoid, return false if it is not well conditioned
+
+	int getSamples(); //Number of used samples
+	float getCondition(); //Min normalised pivot of the last fit
+
+private:
+
+	float M[MAG_CAL_N][MAG_CAL_N]; //Normal-equation matrix, upper triangle
+	float v[MAG_CAL_N]; //Right hand side
+	float last[3] = { 0.0f, 0.0f, 0.0f }; //Last used sample
+	int n = 0; //Number of used samples
+	int n_new = 0; //Used samples since last fit
+	float condition = 0.0f; //Min normalised pivot of the last fit
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "sample_queue.h"
+
+#pragma region SampleQueue::SampleQueue()
+/* SampleQueue constructor */
+SampleQueue::SampleQueue() {
+	Init();
+}
+#pragma endregion
+
+#pragma region void SampleQueue::Init()
+/* Initialization
+Input: /
+Output: /
+Description: empty the queue and reset overrun counter
+*/
+void SampleQueue::Init() {
+	head = 0;
+	tail = 0;
+	overruns = 0;
+}
+#pragma endregion
+
+#pragma region bool SampleQueue::Push(uint32_t _t)
+/* Add event
+Input: uint32_t _t - event time in micros
+Output: bool - false if the queue was full and the event was dropped
+Description: store the time before publishing the new head, so the consumer never reads an unwritten slot
+*/
+bool SampleQueue::Push(uint32_t _t) {
+	uint8_t next = (head + 1) & (SAMPLE_QUEUE_SIZE - 1);
+	if (next == tail) {
+		overruns++;
+		return false;
+	}
+	buffer[head] = _t;
+	head = next;
+	return true;
+}
+#pragma endregion
+
+#pragma region bool SampleQueue::Pop(uint32_t *_t)
+/* Remove oldest event
+Input: uint32_t *_t - destination of event time
+Output: bool - false if the queue was empty
+Description: read the time before releasing the slot to the producer
+*/
+bool SampleQueue::Pop(uint32_t *_t) {
+	if (tail == head) {
+		return false;
+	}
+	*_t = buffer[tail];
+	tail = (tail + 1) & (SAMPLE_QUEUE_SIZE - 1);
+	return true;
+}
+#pragma endregion
+
+#pragma region void SampleQueue::Flush()
+/* Remove all events
+Input: /
+Output: /
+Description: release all queued slots, safe while the producer is running
+*/
+void SampleQueue::Flush() {
+	tail = head;
+}
+#pragma endregion
+
+int SampleQueue::Available() {
+	return (head - tail) & (SAMPLE_QUEUE_SIZE - 1);
+}
+
+// GET FUNCTIONS
+
+uint16_t SampleQueue::getOverruns() {
+	return overruns;
+}
@@ -0,0 +1,35 @@
+/* SAMPLE QUEUE class - lock-free single-producer single-consumer queue of data-ready events used in the MPU9250.h library
+* The data-ready interrupt pushes the time of each new sample, the main loop pops it and reads the sensor. The producer
+* only writes head and the consumer only writes tail, both are single bytes, so no interrupt masking is needed on a
+* single core. One slot is left empty to tell a full queue from an empty one. When the queue is full the event is
+* dropped and counted as overrun.
+*/
+
+#ifndef _SAMPLE_QUEUE_H_
+#define _SAMPLE_QUEUE_H_
+
+#include <Arduino.h>
+
+#define SAMPLE_QUEUE_SIZE 16 //Number of slots, power of 2
+
+class SampleQueue {
+public:
+
+	SampleQueue(); //Constructor
+	void Init(); //Initialization - call only while the producer is stopped
+	bool Push(uint32_t _t); //Add event time in micros - producer only, return false on overrun
+	bool Pop(uint32_t *_t); //Remove oldest event time - consumer only, return false if empty
+	void Flush(); //Remove all events - consumer only
+	int Available(); //Number of queued events
+
+	uint16_t getOverruns(); //Number of dropped events
+
+private:
+
+	volatile uint32_t buffer[SAMPLE_QUEUE_SIZE]; //Event times
+	volatile uint8_t head = 0; //Next slot to write - written by producer
+	volatile uint8_t tail = 0; //Next slot to read - written by consumer
+	volatile uint16_t overruns = 0; //Dropped events - written by producer
+};
+
+#endif
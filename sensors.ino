@@ -12,6 +12,13 @@ LIS2DH12 lis = LIS2DH12();
 
 #define LIS_INT2  6 //PB2
 
+// DPS310 oversampling - 128x takes about 200 ms per conversion, 4x about 10 ms
+#ifdef CONTINUOUS
+  #define DPS310_OVERSAMPLING 2 // keep read_sensors() short, the MPU9250 FIFO holds only 260 ms
+#else
+  #define DPS310_OVERSAMPLING 7
+#endif
+
 // Dps310 object
 Dps310 Dps310PressureSensor = Dps310();
 
@@ -65,15 +72,17 @@ void read_sensors( void )
     int32_t dsp310_temp;
     int32_t dsp310_pres;
     
-    int ret = Dps310PressureSensor.measureTempOnce(dsp310_temp, 7);
-    ret += Dps310PressureSensor.measurePressureOnce(dsp310_pres, 7);
+    int ret = Dps310PressureSensor.measureTempOnce(dsp310_temp, DPS310_OVERSAMPLING);
+    ret += Dps310PressureSensor.measurePressureOnce(dsp310_pres, DPS310_OVERSAMPLING);
     dsp310_pres=dsp310_pres/10;
   
-    hdc2080.read();
+    hdc2080.startMeasurement();
+    sensors_wait(HDC2080_CONVERSION); // wave analysis keeps draining the FIFO in continuous mode
+    hdc2080.readMeasurement();
     float hdc2080_temp = hdc2080.getTemp();
     float hdc2080_hum = hdc2080.getHum();
 
-    packet.sensor.stat=   0x01;
+    packet.sensor.stat=   0x01 | waveAnalyser.getQC(); //QC flags of the wave record in bits 1-6
     packet.sensor.t1  =   (int8_t)hdc2080_temp;
     packet.sensor.t01 =   (uint8_t)((hdc2080_temp-packet.sensor.t1)*100);
     packet.sensor.h1 =    (int8_t)hdc2080_hum;
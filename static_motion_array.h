@@ -0,0 +1,138 @@
+/* STATIC MOTION ARRAY class - compile-time specialised MotionArray used in the wave_analyser.h library
+* Length, filter order, cutoff frequency and sampling time are template parameters. Storage is a member array, so the
+* whole object can be a global without heap use, and the Butterworth low pass coefficients are constexpr -
+* no coefficient math runs on the MCU. The cascade of second (and first) order sections is expanded by templates.
+* Cutoff is given in mHz and sampling time in us, since float template parameters are not allowed.
+* Example: StaticMotionArray<3000, 3, 400, 10000> - 3000 samples, 3rd order, 0.4 Hz cutoff, 10 ms sampling time.
+* Optional Capacity reserves storage for zero padding of frequency domain integration, which integrates the whole record
+* only when Capacity is at least the next power of 2, e.g. StaticMotionArray<3000, 3, 400, 10000, 4096>.
+*/
+
+#ifndef _STATIC_MOTION_ARRAY_H_
+#define _STATIC_MOTION_ARRAY_H_
+
+#include "array_structures.h" //MotionArray base class
+
+namespace Butterworth {
+
+	constexpr double PI_D = 3.14159265358979323846;
+
+	//Taylor series of sine, accurate for |x| <= PI / 2
+	constexpr double sinSeries(double x2, double term, double sum, int k) {
+		return (k > 13) ? sum : sinSeries(x2, -term * x2 / ((2.0 * k) * (2.0 * k + 1.0)), sum + term, k + 1);
+	}
+
+	constexpr double sin(double x) {
+		return sinSeries(x * x, x, 0.0, 1);
+	}
+
+	constexpr double cos(double x) {
+		return sin(PI_D / 2.0 - x);
+	}
+
+	//Prewarped analog frequency K = tan(PI fc Ts) of the bilinear transform
+	constexpr double warp(int cutoff_mhz, int sampling_us) {
+		return sin(PI_D * cutoff_mhz * 1e-3 * sampling_us * 1e-6) / cos(PI_D * cutoff_mhz * 1e-3 * sampling_us * 1e-6);
+	}
+
+	//Quality factor of the k-th pole pair of n-th order filter
+	constexpr double quality(int n, int k) {
+		return 1.0 / (2.0 * sin((2.0 * k + 1.0) * PI_D / (2.0 * n)));
+	}
+
+	/* Second order low pass section k of n-th order filter, direct form II transposed:
+	* y = b0 x + z0, z0 = b1 x - a1 y + z1, z1 = b0 x - a2 y
+	*/
+	template <int Order, int K, int CutoffMilliHz, int SamplingMicros>
+	struct Section {
+		static constexpr double k = warp(CutoffMilliHz, SamplingMicros);
+		static constexpr double q = quality(Order, K);
+		static constexpr double norm = 1.0 / (1.0 + k / q + k * k);
+		static constexpr float b0 = (float)(k * k * norm);
+		static constexpr float b1 = 2.0f * b0;
+		static constexpr float a1 = (float)(2.0 * (k * k - 1.0) * norm);
+		static constexpr float a2 = (float)((1.0 - k / q + k * k) * norm);
+
+		static float filter(float x, float *z) {
+			float y = b0 * x + z[0];
+			z[0] = b1 * x - a1 * y + z[1];
+			z[1] = b0 * x - a2 * y;
+			return y;
+		}
+	};
+
+	/* First order low pass section of odd order filter: y = b0 x + z0, z0 = b0 x - a1 y */
+	template <int CutoffMilliHz, int SamplingMicros>
+	struct FirstOrder {
+		static constexpr double k = warp(CutoffMilliHz, SamplingMicros);
+		static constexpr float b0 = (float)(k / (1.0 + k));
+		static constexpr float a1 = (float)((k - 1.0) / (k + 1.0));
+
+		static float filter(float x, float *z) {
+			float y = b0 * x + z[0];
+			z[0] = b0 * x - a1 * y;
+			return y;
+		}
+	};
+
+	/* Cascade of sections K to the last one, expanded at compile time */
+	template <int Order, int K, int CutoffMilliHz, int SamplingMicros, bool Last = (2 * K + 2 > Order)>
+	struct Cascade {
+		static float filter(float x, float *z) {
+			x = Section<Order, K, CutoffMilliHz, SamplingMicros>::filter(x, z + 2 * K);
+			return Cascade<Order, K + 1, CutoffMilliHz, SamplingMicros>::filter(x, z);
+		}
+	};
+
+	template <int Order, int K, int CutoffMilliHz, int SamplingMicros>
+	struct Cascade<Order, K, CutoffMilliHz, SamplingMicros, true> {
+		static float filter(float x, float *z) {
+			return (Order % 2) ? FirstOrder<CutoffMilliHz, SamplingMicros>::filter(x, z + 2 * K) : x;
+		}
+	};
+}
+
+template <int Length, int Order, int CutoffMilliHz, int SamplingMicros, int Capacity = Length>
+class StaticMotionArray : public MotionArray {
+public:
+
+	static_assert(Order >= 1 && Order <= 8, "Filter order must be between 1 and 8");
+	static_assert(Capacity >= Length, "Capacity must not be shorter than length");
+	static_assert(2L * CutoffMilliHz * SamplingMicros < 1000000000L, "Cutoff must be below the Nyquist frequency");
+
+#pragma region StaticMotionArray(int n_grad)
+	/* Construct static motion array
+	Input: int n_grad - number of points used in gradient calculation
+	*/
+	StaticMotionArray(int n_grad) : MotionArray(storage, Length, n_grad, CutoffMilliHz * 1e-3, SamplingMicros * 1e-6, Capacity) {
+		FilterInit();
+	}
+#pragma endregion
+
+#pragma region float FilterIn(float _x)
+	/* Filter new element through the section cascade */
+	float FilterIn(float _x) {
+		return Butterworth::Cascade<Order, 0, CutoffMilliHz, SamplingMicros>::filter(_x, state);
+	}
+
+	void FilterBlock(int16_t *data, int n) {
+		for (int i = 0; i < n; i++) {
+			float y = max(-32768.0f, min(32767.0f, FilterIn((float)data[i]))); //Saturate before conversion
+			data[i] = (int16_t)lroundf(y);
+		}
+	}
+
+	void FilterInit() {
+		for (int i = 0; i < Order + 1; i++) {
+			state[i] = 0.0;
+		}
+	}
+#pragma endregion
+
+private:
+
+	int16_t storage[Capacity]; //Data storage, Length elements and zero padding
+	float state[Order + 1]; //Section states, two per second order section and one for the first order section
+};
+
+#endif
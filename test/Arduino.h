@@ -0,0 +1,34 @@
+/* ARDUINO STUB - minimal host replacement of the Arduino core for the tests in this directory
+* Only what the tested headers use is declared. Serial output is discarded.
+*/
+
+#ifndef _ARDUINO_STUB_H_
+#define _ARDUINO_STUB_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PI 3.1415926535897932384626433832795
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+struct HardwareSerial {
+	template <class T> void print(T) {}
+	template <class T> void println(T) {}
+	void println() {}
+};
+extern HardwareSerial Serial, Serial1;
+
+unsigned long millis();
+unsigned long micros();
+
+#endif
@@ -0,0 +1,93 @@
+/* AHRS equivalence test - float and Fixed<AHRS_FRAC> Madgwick and Mahony updates over a synthetic motion trace
+* Roll, pitch and yaw oscillate like a buoy in waves, acceleration carries wave motion and noise, magnetic field is
+* in mG like the MPU9250 output, gyro has a constant bias. All filters start from identity with the warm-up beta and
+* must stay within AHRS_TOLERANCE of each other, summed over the quaternion components, for the whole trace.
+* Madgwick runs in nine-axis mode, in six-axis mode (MadgwickUpdateIMU) and in nine-axis mode with gyro drift
+* compensation, whose bias estimates must also agree within AHRS_BIAS_TOLERANCE. The six-axis filter is compared after
+* the warm-up only - with the warm-up beta its gradient step overshoots and passes close to zero, where rounding sets
+* the direction of the normalised step in float and fixed point alike, giving isolated differences of a few 1e-4.
+*/
+
+#include <random>
+#include "../ahrs.h"
+
+#define AHRS_TOLERANCE 1e-4 //Max sum of absolute quaternion component differences
+#define AHRS_DT 0.01f //Sample time in s
+#define AHRS_SAMPLES 12000 //Two minutes of samples
+#define AHRS_WARMUP 10.0f //Duration of warm-up beta in s
+#define AHRS_BIAS_TOLERANCE 1e-5 //Max sum of absolute gyro bias differences in rad/s
+#define AHRS_ZETA 0.05f //Drift gain, larger than in MPU9250.h so the bias converges within the trace
+
+static double difference(Quaternion &f, QuaternionT<AHRSFixed> &x) {
+	return fabs(f.w - x.w.toFloat()) + fabs(f.x - x.x.toFloat()) + fabs(f.y - x.y.toFloat()) + fabs(f.z - x.z.toFloat());
+}
+
+static double difference(float *f, AHRSFixed *x) {
+	return fabs(f[0] - x[0].toFloat()) + fabs(f[1] - x[1].toFloat()) + fabs(f[2] - x[2].toFloat());
+}
+
+static bool check(const char *name, double max_difference, double tolerance) {
+	printf("Max difference float - fixed: %s %.2e, tolerance %.0e\n", name, max_difference, tolerance);
+	return max_difference <= tolerance;
+}
+
+int main() {
+	std::mt19937 rng(1);
+	std::normal_distribution<float> noise(0.0f, 1.0f);
+
+	Quaternion madgwick_f, imu_f, drift_f, mahony_f;
+	QuaternionT<AHRSFixed> madgwick_x, imu_x, drift_x, mahony_x;
+	float e_f[3] = { 0.0f, 0.0f, 0.0f }, bias_f[3] = { 0.0f, 0.0f, 0.0f };
+	AHRSFixed e_x[3], bias_x[3];
+	double max_madgwick = 0.0, max_imu = 0.0, max_drift = 0.0, max_bias = 0.0, max_mahony = 0.0;
+
+	for (int i = 0; i < AHRS_SAMPLES; i++) {
+		float t = i * AHRS_DT;
+		float w1 = 2 * PI / 7, w2 = 2 * PI / 5, w3 = 2 * PI / 30;
+		float roll = 0.3f * sinf(w1 * t), pitch = 0.2f * sinf(w2 * t), yaw = 1.0f + 0.5f * sinf(w3 * t);
+
+		float ax = -sinf(pitch) + 0.01f * noise(rng);
+		float ay = sinf(roll) * cosf(pitch) + 0.01f * noise(rng);
+		float az = cosf(roll) * cosf(pitch) + 0.1f * sinf(2 * PI * t / 6) + 0.01f * noise(rng);
+		float gx = 0.3f * w1 * cosf(w1 * t) + 0.02f + 0.01f * noise(rng);
+		float gy = 0.2f * w2 * cosf(w2 * t) - 0.01f + 0.01f * noise(rng);
+		float gz = 0.5f * w3 * cosf(w3 * t) + 0.01f + 0.01f * noise(rng);
+		float mx = 300 * cosf(yaw) + 3 * noise(rng), my = -300 * sinf(yaw) + 3 * noise(rng), mz = -400 + 3 * noise(rng);
+		bool warmup = t < AHRS_WARMUP;
+		float beta = warmup ? 2.5f : 0.06f; //Warm-up beta, then nominal
+
+		MadgwickUpdate(madgwick_f, ax, ay, az, gx, gy, gz, mx, my, mz, beta, AHRS_DT);
+		MadgwickUpdate(madgwick_x, AHRSFixed(ax), AHRSFixed(ay), AHRSFixed(az), AHRSFixed(gx), AHRSFixed(gy), AHRSFixed(gz),
+			AHRSFixed(mx * AHRS_MAG_SCALE), AHRSFixed(my * AHRS_MAG_SCALE), AHRSFixed(mz * AHRS_MAG_SCALE), AHRSFixed(beta), AHRSFixed(AHRS_DT));
+		MadgwickUpdateIMU(imu_f, ax, ay, az, gx, gy, gz, beta, AHRS_DT);
+		MadgwickUpdateIMU(imu_x, AHRSFixed(ax), AHRSFixed(ay), AHRSFixed(az), AHRSFixed(gx), AHRSFixed(gy), AHRSFixed(gz),
+			AHRSFixed(beta), AHRSFixed(AHRS_DT));
+		MadgwickUpdate(drift_f, ax, ay, az, gx, gy, gz, mx, my, mz, beta, AHRS_DT, bias_f, AHRS_ZETA);
+		MadgwickUpdate(drift_x, AHRSFixed(ax), AHRSFixed(ay), AHRSFixed(az), AHRSFixed(gx), AHRSFixed(gy), AHRSFixed(gz),
+			AHRSFixed(mx * AHRS_MAG_SCALE), AHRSFixed(my * AHRS_MAG_SCALE), AHRSFixed(mz * AHRS_MAG_SCALE), AHRSFixed(beta), AHRSFixed(AHRS_DT),
+			bias_x, AHRSFixed(AHRS_ZETA));
+		MahonyUpdate(mahony_f, ax, ay, az, gx, gy, gz, mx, my, mz, e_f, 10.0f, 0.0f, AHRS_DT);
+		MahonyUpdate(mahony_x, AHRSFixed(ax), AHRSFixed(ay), AHRSFixed(az), AHRSFixed(gx), AHRSFixed(gy), AHRSFixed(gz),
+			AHRSFixed(mx * AHRS_MAG_SCALE), AHRSFixed(my * AHRS_MAG_SCALE), AHRSFixed(mz * AHRS_MAG_SCALE), e_x, AHRSFixed(10.0f), AHRSFixed(0.0f), AHRSFixed(AHRS_DT));
+
+		max_madgwick = max(max_madgwick, difference(madgwick_f, madgwick_x));
+		if (!warmup) {
+			max_imu = max(max_imu, difference(imu_f, imu_x));
+		}
+		max_drift = max(max_drift, difference(drift_f, drift_x));
+		max_bias = max(max_bias, difference(bias_f, bias_x));
+		max_mahony = max(max_mahony, difference(mahony_f, mahony_x));
+	}
+
+	bool pass = check("Madgwick", max_madgwick, AHRS_TOLERANCE);
+	pass &= check("Madgwick IMU after warm-up", max_imu, AHRS_TOLERANCE);
+	pass &= check("Madgwick with drift compensation", max_drift, AHRS_TOLERANCE);
+	pass &= check("gyro bias", max_bias, AHRS_BIAS_TOLERANCE);
+	pass &= check("Mahony", max_mahony, AHRS_TOLERANCE);
+	if (!pass) {
+		printf("FAIL\n");
+		return 1;
+	}
+	printf("PASS\n");
+	return 0;
+}
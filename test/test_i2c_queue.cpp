@@ -0,0 +1,256 @@
+/* I2C queue test - I2CQueue on a scripted fake bus
+* The fake bus plays a script of expected transactions: slave address, written bytes, and the status and bytes the
+* slave answers with. It checks that transactions reach the bus in queue order and only from Poll(), and records
+* completion callbacks. Blocking and asynchronous buses are both tested - the asynchronous one finishes a transfer
+* only when the test fires its end of transfer "interrupt", and may refuse a transfer while it is busy.
+*/
+
+#include "../i2c_queue.h"
+
+#define SCRIPT_MAX 8 //Max steps of a script
+#define CALLBACKS_MAX 16 //Max recorded callbacks
+
+struct Step {
+	uint8_t address; //Expected slave address
+	uint8_t tx[2]; //Expected written bytes
+	uint8_t tx_size;
+	uint8_t status; //Status of endTransmission, or of the asynchronous transfer
+	uint8_t rx[4]; //Bytes the slave answers with
+	uint8_t rx_size; //Number of answered bytes - fewer than requested is an incomplete read
+};
+
+class FakeBus : public I2CBus {
+public:
+
+	Step script[SCRIPT_MAX];
+	int n_script = 0; //Number of steps
+	int step = 0; //Next step
+	int errors = 0; //Transactions different from the script
+	bool async = false; //Asynchronous transfers
+	int refuse = 0; //Number of transfers to refuse as busy
+
+	//Asynchronous transfer in progress
+	volatile uint8_t *status = NULL;
+	I2CTransferCallback callback = NULL;
+
+	void Add(uint8_t address, uint8_t reg, int data, uint8_t status, const uint8_t *rx = NULL, uint8_t rx_size = 0) {
+		Step *s = &script[n_script++];
+		s->address = address;
+		s->tx[0] = reg;
+		s->tx[1] = (uint8_t)data;
+		s->tx_size = (data < 0) ? 1 : 2;
+		s->status = status;
+		for (int i = 0; i < rx_size; i++) {
+			s->rx[i] = rx[i];
+		}
+		s->rx_size = rx_size;
+	}
+
+	//Blocking TwoWire calls
+	void beginTransmission(uint8_t address) {
+		check(address);
+		tx_size = 0;
+	}
+
+	size_t write(const uint8_t *data, size_t size) {
+		for (size_t i = 0; i < size && tx_size < 2; i++) {
+			tx[tx_size++] = data[i];
+		}
+		return size;
+	}
+
+	uint8_t endTransmission(bool stop) {
+		Step *s = current();
+		if (s && (tx_size != s->tx_size || tx[0] != s->tx[0] || (tx_size == 2 && tx[1] != s->tx[1]))) {
+			errors++;
+		}
+		rx_pos = 0;
+		if (stop) {
+			step++;
+		}
+		return s ? s->status : 0;
+	}
+
+	uint8_t requestFrom(uint8_t address, uint8_t size) {
+		Step *s = current();
+		step++;
+		rx_step = s;
+		return s ? min(size, s->rx_size) : 0;
+	}
+
+	int available() {
+		return (rx_step && rx_pos < rx_step->rx_size) ? 1 : 0;
+	}
+
+	int read() {
+		return rx_step->rx[rx_pos++];
+	}
+
+	//Asynchronous transfer
+	bool isAsync() {
+		return async;
+	}
+
+	bool transfer(uint8_t address, uint8_t *_tx, uint8_t _tx_size, uint8_t *rx, uint8_t rx_size, volatile uint8_t *_status,
+		I2CTransferCallback _callback) {
+		if (callback || refuse > 0) {
+			refuse--;
+			return false;
+		}
+		check(address);
+		Step *s = current();
+		step++;
+		if (!s || _tx_size != s->tx_size || _tx[0] != s->tx[0] || (_tx_size == 2 && _tx[1] != s->tx[1])) {
+			errors++;
+			return false;
+		}
+		for (int i = 0; i < min(rx_size, s->rx_size); i++) {
+			rx[i] = s->rx[i];
+		}
+		*_status = s->status;
+		status = _status;
+		callback = _callback;
+		return true;
+	}
+
+	//End of transfer interrupt
+	void Interrupt() {
+		I2CTransferCallback c = callback;
+		callback = NULL;
+		c();
+	}
+
+private:
+
+	uint8_t tx[2];
+	uint8_t tx_size = 0;
+	Step *rx_step = NULL;
+	int rx_pos = 0;
+
+	Step *current() {
+		return (step < n_script) ? &script[step] : NULL;
+	}
+
+	void check(uint8_t address) {
+		if (!current() || current()->address != address) {
+			errors++;
+		}
+	}
+};
+
+struct Completion {
+	int id; //Context of the transaction
+	uint8_t status;
+};
+
+static Completion completed[CALLBACKS_MAX];
+static int n_completed = 0;
+
+static void onDone(void *context, uint8_t status) {
+	completed[n_completed].id = (int)(intptr_t)context;
+	completed[n_completed].status = status;
+	n_completed++;
+}
+
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+	if (!condition) {
+		printf("FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+static void testBlocking() {
+	FakeBus bus;
+	I2CQueue i2c(&bus);
+	n_completed = 0;
+
+	const uint8_t who[1] = { 0x71 };
+	const uint8_t acc[3] = { 1, 2, 3 };
+	bus.Add(0x68, 0x6B, 0x01, I2C_OK); //Write
+	bus.Add(0x68, 0x75, -1, I2C_OK, who, 1); //Read of one byte
+	bus.Add(0x68, 0x3B, -1, I2C_OK, acc, 2); //Read of three bytes, slave answers two
+	bus.Add(0x0C, 0x0A, 0x00, 2); //Write, address not acknowledged
+
+	uint8_t who_rx[1] = { 0 }, acc_rx[3] = { 0, 0, 0 };
+	expect(i2c.Write(0x68, 0x6B, 0x01, onDone, (void *)1), "queue write");
+	expect(i2c.Read(0x68, 0x75, who_rx, 1, onDone, (void *)2), "queue read");
+	expect(i2c.Read(0x68, 0x3B, acc_rx, 3, onDone, (void *)3), "queue incomplete read");
+	expect(i2c.Write(0x0C, 0x0A, 0x00, onDone, (void *)4), "queue write to missing slave");
+	expect(bus.step == 0 && i2c.isBusy(), "nothing is started before Poll");
+
+	for (int i = 0; i < 10 && i2c.isBusy(); i++) {
+		i2c.Poll();
+	}
+
+	expect(!i2c.isBusy(), "blocking queue drained");
+	expect(bus.errors == 0 && bus.step == bus.n_script, "blocking transactions in queue order");
+	expect(n_completed == 4, "one callback per transaction");
+	for (int i = 0; i < n_completed; i++) {
+		expect(completed[i].id == i + 1, "callbacks in queue order");
+	}
+	expect(completed[0].status == I2C_OK && completed[1].status == I2C_OK, "status of complete transactions");
+	expect(who_rx[0] == 0x71, "read data");
+	expect(completed[2].status == I2C_INCOMPLETE && acc_rx[0] == 1 && acc_rx[1] == 2, "short read is I2C_INCOMPLETE");
+	expect(completed[3].status == 2, "Wire error code is kept");
+}
+
+static void testAsync() {
+	FakeBus bus;
+	bus.async = true;
+	bus.refuse = 1; //Bus is busy at first
+	I2CQueue i2c(&bus);
+	n_completed = 0;
+
+	const uint8_t frame[4] = { 9, 8, 7, 6 };
+	bus.Add(0x68, 0x3A, -1, I2C_OK, frame, 4);
+	bus.Add(0x68, 0x6B, 0x40, I2C_OK);
+
+	uint8_t frame_rx[4] = { 0, 0, 0, 0 };
+	i2c.Read(0x68, 0x3A, frame_rx, 4, onDone, (void *)1);
+	i2c.Write(0x68, 0x6B, 0x40, onDone, (void *)2);
+
+	i2c.Poll();
+	expect(bus.step == 0 && bus.callback == NULL, "refused transfer is not started");
+	i2c.Poll();
+	expect(bus.step == 1 && bus.callback != NULL, "refused transfer is retried on next Poll");
+	i2c.Poll();
+	expect(bus.step == 1 && n_completed == 0, "next transfer waits for the end of the previous one");
+
+	bus.Interrupt();
+	expect(n_completed == 0, "callback is not called from interrupt");
+	i2c.Poll();
+	expect(n_completed == 1 && completed[0].id == 1 && completed[0].status == I2C_OK, "callback from Poll after interrupt");
+	expect(frame_rx[0] == 9 && frame_rx[3] == 6, "asynchronous read data");
+	expect(bus.step == 2 && i2c.isBusy(), "Poll starts the next transfer");
+
+	bus.Interrupt();
+	i2c.Poll();
+	expect(n_completed == 2 && completed[1].id == 2 && !i2c.isBusy(), "asynchronous queue drained");
+	expect(bus.errors == 0, "asynchronous transactions in queue order");
+}
+
+static void testFull() {
+	FakeBus bus;
+	I2CQueue i2c(&bus);
+	int queued = 0;
+	while (queued <= I2C_QUEUE_SIZE && i2c.Write(0x68, 0x6B, 0x00)) {
+		queued++;
+	}
+	expect(queued == I2C_QUEUE_SIZE - 1, "full queue refuses transactions");
+	i2c.Init();
+	expect(!i2c.isBusy(), "Init drops queued transactions");
+}
+
+int main() {
+	testBlocking();
+	testAsync();
+	testFull();
+	if (failures > 0) {
+		printf("FAIL\n");
+		return 1;
+	}
+	printf("PASS\n");
+	return 0;
+}
@@ -0,0 +1,56 @@
+/* Frequency domain integration test - heave of a synthetic two-component sea from its acceleration
+* Acceleration in mg of 8 s and 5 s waves is integrated by MotionArray::IntegrateDisplacement, zero padded to the next
+* power of 2. The valid heave must be the untapered middle of the record, moved to the start of the array, and all of
+* it must stay within INTEGRATION_TOLERANCE of the true heave, relative to the largest amplitude.
+*/
+
+#include "../array_structures.h"
+
+#define INTEGRATION_N 3000 //Record length, not a power of 2
+#define INTEGRATION_DT 0.1f //Sample time in s - decimated, 5 min record
+#define INTEGRATION_TOLERANCE 0.05 //Max heave error relative to the largest amplitude
+#define INTEGRATION_TAPER (INTEGRATION_N / 10) //Tapered samples at each end
+
+HardwareSerial Serial, Serial1;
+
+static double heave(int i, double *acc) {
+	const double a[2] = { 500.0, 200.0 }; //Amplitude in mm
+	const double T[2] = { 8.0, 5.3 }; //Period in s
+	double t = i * INTEGRATION_DT, z = 0.0;
+	*acc = 0.0;
+	for (int k = 0; k < 2; k++) {
+		double w = 2.0 * PI / T[k];
+		z += a[k] * sin(w * t + k);
+		*acc -= a[k] * w * w * sin(w * t + k) / GRAV_CONSTANT; //mm/s^2 to mg
+	}
+	return z;
+}
+
+int main() {
+	MotionArray A(INTEGRATION_N, 10, 0.4, INTEGRATION_DT, 3);
+	A.dt = INTEGRATION_DT;
+	int len = A.PaddedLength();
+	if (!A.Reserve(len)) {
+		printf("FAIL - no storage for %d elements\n", len);
+		return 1;
+	}
+	double acc;
+	for (int i = 0; i < INTEGRATION_N; i++) {
+		heave(i, &acc);
+		A.x[i] = (int16_t)lround(acc);
+	}
+
+	int n = A.IntegrateDisplacement(INTEGRATION_CUTOFF);
+	double max_error = 0.0;
+	for (int i = 0; i < n; i++) {
+		max_error = max(max_error, fabs(A.x[i] - heave(i + INTEGRATION_TAPER, &acc)));
+	}
+
+	printf("Valid heave: %d of %d, padded to %d, max error of valid heave: %.1f mm of 500 mm\n", n, INTEGRATION_N, len, max_error);
+	if (n != A.getLength() || n != INTEGRATION_N - 2 * INTEGRATION_TAPER || max_error > INTEGRATION_TOLERANCE * 500.0) {
+		printf("FAIL\n");
+		return 1;
+	}
+	printf("PASS\n");
+	return 0;
+}
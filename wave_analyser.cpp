@@ -10,10 +10,31 @@ Input: All default value parameters
 * int n_grad - distance for the gradient calculation
 * int innitial_calibration_delay - milliseconds of initial calculation delay
 * int n_w - number of waves to be recorded in single iteration
+* bool stream - analyse each sample as it arrives, without storing the data array
+* int decimation - decimation factor of acceleration before analysis. Sampling time, n_grad and N_GRAD_COUNT are
+  given at the sensor rate and are scaled, n_data_array holds decimated samples.
 */
-WaveAnalyser::WaveAnalyser(float cutoff_freq, float sampling_time, int order, int n_data_array, int n_grad, int innitial_calibration_delay, int n_w) {
+WaveAnalyser::WaveAnalyser(float cutoff_freq, float sampling_time, int order, int n_data_array, int n_grad, int innitial_calibration_delay, int n_w, bool stream,
+	int decimation_factor) {
 
-	A = new MotionArray(n_data_array, n_grad, cutoff_freq, sampling_time, order); //Construct motion array for storing acceleration data
+	//Decimation stage
+	if (decimation_factor > 1) {
+		D = new Decimator(decimation_factor);
+		decimation = decimation_factor;
+		sampling_time *= decimation;
+		n_grad = max(1, n_grad / decimation);
+		n_grad_count = max(1, N_GRAD_COUNT / decimation);
+	}
+
+	streaming = stream;
+	if (streaming) {
+		A = NULL;
+		S = new WaveStream(n_grad, n_grad_count, cutoff_freq, sampling_time, order); //Construct one-pass analyser, no data array
+	}
+	else {
+		A = new MotionArray(n_data_array, n_grad, cutoff_freq, sampling_time, order); //Construct motion array for storing acceleration data
+		S = NULL;
+	}
 	
 	calibration_delay = innitial_calibration_delay; //Set calibration delay
 	n_waves = n_w; //Set number of waves to be calculated
@@ -24,6 +45,26 @@ WaveAnalyser::WaveAnalyser(float cutoff_freq, float sampling_time, int order, in
 }
 #pragma endregion
 
+#pragma region WaveAnalyser::WaveAnalyser(MotionArray *array, int innitial_calibration_delay, int n_w)
+/* WaveAnalyser constructor with given data array
+Input:
+* MotionArray *array - data array with its own filter, e.g. a global StaticMotionArray without heap use
+* int innitial_calibration_delay - milliseconds of initial calculation delay
+* int n_w - number of waves to be recorded in single iteration
+*/
+WaveAnalyser::WaveAnalyser(MotionArray *array, int innitial_calibration_delay, int n_w) {
+
+	A = array;
+	S = NULL;
+	calibration_delay = innitial_calibration_delay; //Set calibration delay
+	n_waves = n_w; //Set number of waves to be calculated
+
+#ifdef SD_CARD
+	sprintf(filename, "/Log.txt"); //Set filename
+#endif // SD_CARD
+}
+#pragma endregion
+
 #pragma region void WaveAnalyser::init()
 /* Initialization
 Input: /
@@ -33,6 +74,45 @@ Description:
 */
 void WaveAnalyser::init() {
 	
+	resetWaves();
+	waves_done = false;
+	window_busy = false;
+	n_pending = 0;
+	qc.Init();
+	for (int i = 0; i < QC_HOPS_MAX; i++) {
+		qc_hops[i] = 0;
+	}
+	qc_hop = 0;
+
+	//Initialize array classes
+	if (A) {
+		A->Init();
+	}
+	if (S) {
+		S->Init();
+	}
+	if (D) {
+		D->Init();
+	}
+
+	wait_time = millis(); //Reset wait time
+	print_wait_time = 0; //Reset print time
+	verify = mpu.isWarm(); //Quaternions from before sleep need only verification
+	calibrated = false;
+	wait_delay = verify ? WARM_START_DELAY : calibration_delay;
+	tilt_sum = 0.0;
+	tilt_n = 0;
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::resetWaves()
+/* Reset wave detection
+Input: /
+Output: /
+Description: initialize gradient, extreme and result variables
+*/
+void WaveAnalyser::resetWaves() {
+
 	grad = 0;
 	current_grad = 0;
 	grad_count = 0;
@@ -42,12 +122,6 @@ void WaveAnalyser::init() {
 	wave_avg = 0.0;
 	wave_significant = 0.0;
 	period_avg = 0.0;
-
-	//Initialize array classes
-	A->Init();
-
-	wait_time = millis(); //Reset wait time
-	print_wait_time = 0; //Reset print time
 }
 #pragma endregion
 
@@ -69,6 +143,18 @@ void WaveAnalyser::setup() {
 		half_period[i] = 0.0;
 	}
 	wave_counter = 0;
+	stats.Init();
+
+	//Spectrum is kept over repeated scanning, reset it only here
+	spectrum.Init();
+	if (W) {
+		W->Init();
+	}
+	welch_done = false;
+	if (DS) {
+		DS->Init();
+	}
+	directional_done = false;
 
 	//Start SD card and log file
 #ifdef SD_CARD
@@ -96,38 +182,64 @@ Output: bool - return true when analysis is completed
 Description:
 * Update MPU measurement - if new value, true is returned -> proceed
 * Check if the initial wait time has passed. During the wait time display seconds left.
-* Add new rotated z-acceleration value and time interval to the calculation array
-* If calculation array is full, send MPU9250 sensor to sleep and proceed with data analysis
-* Check if we have desired number of crests and troughs, if yes analyse size and period. Initialize the class. 
+* Calibration ends early when the orientation filter reports convergence, the delay is only the ceiling
+* After warm start the wait is a short verification - if the mean tilt error of the quaternions is too large, wait
+  for the full calibration delay
+* If directional analysis is enabled, add east, north and up acceleration at the sensor rate until its record is complete
+* Pass new rotated z-acceleration value and time interval through the quality control and analyse the checked samples
+* In continuous mode analyse the next part of the current window first - update() returns true when it is done
 */
 bool WaveAnalyser::update() {
 
+	if (window_busy && stepWindow(window_step)) {
+		return true;
+	}
+
 	if (mpu.update()) {
 
 		//Check if waiting period is done
-		if (millis() - wait_time > calibration_delay)
+		if (calibrated || millis() - wait_time > wait_delay || mpu.isConverged())
 		{
-			bool full = A->AddElement(mpu.getZacc(), mpu.getDt()); //Add new acceleration value and time interval
-
-			//LOG(1, "%d, %d, %d, %d, %d, %d", mpu.getDt(), mpu.getZacc(), A_raw->GetTimeInterval(), A_raw->UpdateAverage(), A->GetTimeInterval(), grad);
-		
-			if (full) {
-				//mpu.MPU9250sleep();
-				LOG(1, "MPU9250 to sleep.");
-				bool done = analyseData();
-				if (done) {
-					mpu.MPU9250sleep();
+			if (!calibrated && verify) {
+				verify = false;
+				float tilt = (tilt_n > 0) ? tilt_sum / (float)tilt_n : 180.0;
+				if (!mpu.isConverged() && tilt > WARM_START_MAX_TILT) {
+					LOG(1, "Warm start rejected, tilt error: %d", (int)tilt);
+					wait_delay = calibration_delay;
+					return false;
 				}
-				return done;
+				LOG(1, "Warm start verified, tilt error: %d", (int)tilt);
+			}
+			if (!calibrated) {
+				calibrated = true;
+				LOG(1, "Calibration done after %d s", (int)((millis() - wait_time) / 1000));
+			}
+			int16_t z = mpu.getVerticalAcc();
+			float dt = mpu.getDt();
+			bool direction_done = true;
+			if (DS) {
+				direction_done = analyseDirection(mpu.getEastAcc(), mpu.getNorthAcc(), z, dt);
 			}
+
+			//Quality control - a repaired gap gives more than one sample
+			int n = qc.AddElement(z, dt, mpu.isClipped(), mpu.isValid());
+			bool done = false;
+			for (int i = 0; i < n && (!done || continuous); i++) {
+				done |= analyseSample(qc.getElement(i), qc.getDt(i), direction_done);
+			}
+			return done;
 		}
 		//Display waiting time in seconds
 		else {
+			if (verify) {
+				tilt_sum += mpu.getTiltError();
+				tilt_n++;
+			}
 			if ((millis() - wait_time) > print_wait_time * 1000)
 			{
 				print_wait_time++;
-				LOG(1, "Wait for: %d", calibration_delay / 1000 - (millis() - wait_time) / 1000);
-				if (print_wait_time == calibration_delay/1000 )
+				LOG(1, "Wait for: %d", wait_delay / 1000 - (millis() - wait_time) / 1000);
+				if (print_wait_time == wait_delay/1000 )
 				{
 					LOG(1, "Log data for ca. 30 s.");
 #ifdef SD_CARD
@@ -144,15 +256,87 @@ bool WaveAnalyser::update() {
 }
 #pragma endregion
 
+#pragma region bool WaveAnalyser::analyseSample(int16_t z, float dt, bool direction_done)
+/* Analyse checked sample
+Input: int16_t z - rotated z-acceleration, float dt - time interval, bool direction_done - directional record is complete
+Output: bool - return true when analysis is completed
+Description:
+* Add new value and time interval to the calculation array, through the decimation stage if enabled
+* If calculation array is full, send MPU9250 sensor to sleep and proceed with data analysis
+* Check if we have desired number of crests and troughs, if yes analyse size and period. Initialize the class. 
+* In streaming mode pass each value to the one-pass analyser instead
+* If Welch spectrum is enabled, keep acquiring until the Welch record is complete
+* In continuous mode start analysis of each new window and keep acquiring - MPU9250 sensor is never sent to sleep.
+  The ring must not change during the analysis, so new samples are kept pending until it is done. If the pending
+  buffer is full, the window is finished at once.
+*/
+bool WaveAnalyser::analyseSample(int16_t z, float dt, bool direction_done) {
+
+	//Decimate
+	if (D) {
+		if (!D->AddElement(z, dt)) {
+			return false;
+		}
+		z = D->getElement();
+		dt = D->getDt();
+	}
+
+	if (continuous) {
+		bool done = false;
+		if (window_busy && n_pending == WINDOW_PENDING) {
+			done = stepWindow(A->getLength()); //Finish the window
+		}
+		if (window_busy) {
+			pending_x[n_pending] = z;
+			pending_dt[n_pending] = dt;
+			n_pending++;
+		}
+		else if (A->AddElement(z, dt)) {
+			startWindow(); //New window is ready
+		}
+		return done;
+	}
+
+	if (!waves_done) {
+		if (streaming) {
+			waves_done = analyseStream(z, dt);
+		}
+		else {
+			bool full = A->AddElement(z, dt); //Add new acceleration value and time interval
+
+			//LOG(1, "%d, %d, %d, %d, %d, %d", mpu.getDt(), mpu.getVerticalAcc(), A_raw->GetTimeInterval(), A_raw->UpdateAverage(), A->GetTimeInterval(), grad);
+
+			if (full) {
+				waves_done = analyseData();
+			}
+		}
+	}
+
+	bool record_done = analyseWelch(z, dt);
+
+	if (waves_done && record_done && direction_done) {
+		LOG(1, "QC FLAGS: %d", qc.getFlags());
+		LOG(1, "MPU9250 to sleep.");
+		mpu.MPU9250sleep();
+		return true;
+	}
+	return false;
+}
+#pragma endregion
+
 #pragma region bool WaveAnalyser::analyseData()
 /* Data analysis
 Input: / 
 Output: bool - return true if sufficient waves are detected
 Description:
-* Apply low pass filter to the data
+* With forward filter and time domain integration filter, analyse gradient and calculate waves in a single pass
+* Otherwise apply low pass filter to the data, forward and backward in zero-phase mode
+* In frequency integration mode integrate the data into heave - only the valid part of array is analysed afterwards
 * Analyse gradient and determine min/max points
 * Calculate wave heights
 * Analyse height data
+* With zero-upcrossing detection analyse waves of the heave in one pass instead
+* When analysis is completed, calculate spectral parameters - the data array is overwritten. Skipped if Welch spectrum is enabled.
 */
 bool WaveAnalyser::analyseData() {
 
@@ -163,7 +347,14 @@ bool WaveAnalyser::analyseData() {
 		logfile.println(A->x[i]);
 #endif
 
-	A->FilterData(); //Apply low-pass filter to data
+	bool fused = !zero_phase && integration == INTEGRATE_TIME;
+	if (fused) {
+		LOG(1, "Identifying waves...");
+		analyseFused(); //Filter, analyse gradient and calculate waves in one pass
+	}
+	else {
+		A->FilterData(zero_phase); //Apply low-pass filter to data
+	}
 
 #ifdef SD_CARD
 	logfile.print("Average dt: ");
@@ -171,11 +362,248 @@ bool WaveAnalyser::analyseData() {
 	logfile.close();
 #endif // SD_CARD
 
+	if (!fused) {
+		if (integration == INTEGRATE_FREQUENCY) {
+			LOG(1, "Integrating data...");
+			if (A->IntegrateDisplacement(integration_cutoff) == 0) {
+				LOG(1, "Array too short for integration.");
+			}
+		}
+
+		LOG(1, "Identifying waves...");
+		if (detection == DETECT_GRADIENT) {
+			analyseGradient(); //Analyse gradient and determine min/max points
+			calculateWaves(); //Calculate new waves
+		}
+	}
+
+	bool done = (detection == DETECT_UPCROSSING) ? analyseUpcrossing() : analyseWaves(); //Analyse wave data
+	if (done && spectral && !W) {
+		LOG(1, "Calculating spectrum...");
+		if (spectrum.Analyse(A->x, A->getLength(), A->dt, integration == INTEGRATE_FREQUENCY)) {
+			LOG(1, "SPECTRAL WAVE HM0: %d", (int)(spectrum.getHm0() * 100));
+			LOG(1, "PEAK PERIOD TP: %d", (int)(spectrum.getTp() * 100));
+			LOG(1, "MEAN PERIOD TM01: %d", (int)(spectrum.getTm01() * 100));
+			LOG(1, "MEAN PERIOD TM02: %d", (int)(spectrum.getTm02() * 100));
+		}
+	}
+	return done;
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::startWindow()
+/* Start analysis of window of continuous acquisition
+Input: /
+Output: /
+Description:
+* Data in the ring is already filtered and is not modified - the next window reuses the overlapping part
+* Keep quality control flags of samples added since the previous window, the window spans ceil(N / N_hop) such hops -
+  report flags of all of them, so a flag in the overlap is reported by every window that analyses it
+* Reset wave detection and results of the previous window
+* Split the window into steps, so it is analysed before the pending buffer is half full if update() is called once per sample
+*/
+void WaveAnalyser::startWindow() {
+
+	qc_hops[qc_hop] = qc.getFlags();
+	qc_hop = (qc_hop + 1) % QC_HOPS_MAX;
+	qc.ClearFlags();
+	int hops = min(QC_HOPS_MAX, (A->N + A->N_hop - 1) / A->N_hop);
+	qc_window = 0;
+	for (int i = 1; i <= hops; i++) {
+		qc_window |= qc_hops[(qc_hop - i + QC_HOPS_MAX) % QC_HOPS_MAX];
+	}
+	LOG(1, "QC FLAGS: %d", qc_window);
+	resetWaves();
+	wave_counter = 0;
+	stats.Init();
+
 	LOG(1, "Identifying waves...");
-	analyseGradient(); //Analyse gradient and determine min/max points
-	calculateWaves(); //Calculate new waves
+	window_busy = true;
+	window_pos = 0;
+	window_step = max(1, A->getLength() / (WINDOW_PENDING / 2));
+}
+#pragma endregion
+
+#pragma region bool WaveAnalyser::stepWindow(int n)
+/* Analyse next part of window of continuous acquisition
+Input: int n - number of points to analyse
+Output: bool - return true when analysis is completed
+Description:
+* Analyse gradient of the next n points - the whole ring is filtered, so the gradient needs no lag
+* When a new extreme is confirmed, calculate height of the half-wave before the previous extreme
+* At the end of window, or when sufficient waves are measured, calculate the last half-wave and analyse height data
+* Add pending samples to the ring
+*/
+bool WaveAnalyser::stepWindow(int n) {
+
+	int end = min(A->getLength(), window_pos + n);
+	for (; window_pos < end && wave_counter < 2 * n_waves; window_pos++) {
+		if (gradientStep(window_pos) && wave_max_counter >= 3) {
+			calculateWave(wave_max_counter - 2); //Half-wave before the last extreme
+		}
+	}
+	if (window_pos < A->getLength() && wave_counter < 2 * n_waves) {
+		return false;
+	}
+	if (wave_max_counter >= 2) {
+		calculateWave(wave_max_counter - 1); //Last half-wave
+	}
+
+	window_busy = false;
+	bool done = analyseWaves();
+	flushPending();
+	return done;
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::flushPending()
+/* Add pending samples to the ring
+Input: /
+Output: /
+Description: stop when a sample completes the next window, the rest stays pending until that window is analysed
+*/
+void WaveAnalyser::flushPending() {
+
+	int i = 0;
+	while (i < n_pending && !window_busy) {
+		if (A->AddElement(pending_x[i], pending_dt[i])) {
+			startWindow(); //New window is ready
+		}
+		i++;
+	}
+	for (int j = i; j < n_pending; j++) {
+		pending_x[j - i] = pending_x[j];
+		pending_dt[j - i] = pending_dt[j];
+	}
+	n_pending -= i;
+}
+#pragma endregion
+
+#pragma region bool WaveAnalyser::analyseStream(int16_t _x, float _dt)
+/* One-pass data analysis
+Input: int16_t _x - new acceleration, float _dt - new time interval
+Output: bool - return true when analysis is completed
+Description:
+* Add new value to the one-pass analyser
+* Store each finished half-wave height and half-period
+* Close the record when N_STREAM_MAX samples were streamed
+* When sufficient waves are measured or the record is closed, analyse wave heights
+*/
+bool WaveAnalyser::analyseStream(int16_t _x, float _dt) {
 
-	return(analyseWaves()); //Analyse wave data
+	bool ready = S->AddElement(_x, _dt);
+	bool timeout = S->getElements() >= N_STREAM_MAX;
+	if (timeout && !ready) {
+		ready = S->Flush(); //Finish last half-wave
+	}
+
+	if (ready && wave_counter < 2 * n_waves) {
+		height[wave_counter] = S->getHeight();
+		half_period[wave_counter] = S->getHalfPeriod();
+		LOG(2, "Height: %d", (int)(height[wave_counter] * 100));
+		stats.AddHeight(height[wave_counter]);
+		wave_counter++;
+	}
+	wave_max_counter = S->getExtremes();
+
+	if (wave_counter == 2 * n_waves || timeout) {
+		return(analyseWaves());
+	}
+	return false;
+}
+#pragma endregion
+
+#pragma region bool WaveAnalyser::analyseWelch(int16_t _x, float _dt)
+/* Welch spectrum update
+Input: int16_t _x - new acceleration, float _dt - new time interval
+Output: bool - return true when Welch record is complete or Welch spectrum is disabled
+Description:
+* Add new value to the Welch accumulator, segments are transformed during acquisition
+* When the record time is reached, calculate spectral parameters from the averaged density
+*/
+bool WaveAnalyser::analyseWelch(int16_t _x, float _dt) {
+
+	if (!W || welch_done) {
+		return true;
+	}
+
+	W->AddElement(_x, _dt);
+	if (W->getTime() * 1000.0 < (float)welch_record) {
+		return false;
+	}
+
+	welch_done = true;
+	if (spectrum.AnalysePSD(W->getPSD(), W->getBins(), W->getDf())) {
+		LOG(1, "WELCH SEGMENTS: %d", W->getSegments());
+		LOG(1, "SPECTRAL WAVE HM0: %d", (int)(spectrum.getHm0() * 100));
+		LOG(1, "PEAK PERIOD TP: %d", (int)(spectrum.getTp() * 100));
+		LOG(1, "MEAN PERIOD TM01: %d", (int)(spectrum.getTm01() * 100));
+		LOG(1, "MEAN PERIOD TM02: %d", (int)(spectrum.getTm02() * 100));
+	}
+	return true;
+}
+#pragma endregion
+
+#pragma region bool WaveAnalyser::analyseDirection(int16_t east, int16_t north, int16_t up, float _dt)
+/* Directional spectrum update
+Input: int16_t east, int16_t north, int16_t up - new earth-frame accelerations, float _dt - new time interval
+Output: bool - return true when directional record is complete or directional analysis is disabled
+Description:
+* Add new values to the directional accumulator, segments are transformed during acquisition
+* When the record time is reached, calculate mean direction, peak direction and spread
+*/
+bool WaveAnalyser::analyseDirection(int16_t east, int16_t north, int16_t up, float _dt) {
+
+	if (!DS || directional_done) {
+		return true;
+	}
+
+	DS->AddElement(east, north, up, _dt);
+	if (DS->getTime() * 1000.0 < (float)directional_record) {
+		return false;
+	}
+
+	directional_done = true;
+	if (DS->Analyse()) {
+		LOG(1, "MEAN DIRECTION: %d", (int)DS->getMeanDirection());
+		LOG(1, "PEAK DIRECTION: %d", (int)DS->getPeakDirection());
+		LOG(1, "DIRECTIONAL SPREAD: %d", (int)DS->getSpread());
+	}
+	return true;
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::analyseFused()
+/* Single pass data analysis
+Input: /
+Output: /
+Description:
+* Filter data element by element in place
+* Gradient of a point needs N_gradient filtered points ahead - analyse the point N_gradient behind the filtered one
+* When a new extreme is confirmed, offsets on both sides of the previous half-wave are known - calculate its height
+* Calculate the last half-wave at the end of the array
+* Stop early when sufficient waves are measured, unless the whole filtered array is needed for the spectrum
+*/
+void WaveAnalyser::analyseFused() {
+
+	A->StartFilter();
+	bool whole = spectral && !W; //Spectrum needs the whole filtered array
+	int lag = A->N_gradient;
+
+	for (int i = 0; i < A->N + lag; i++) {
+		if (i < A->N) {
+			A->FilterElement(i);
+		}
+		if (i >= lag && gradientStep(i - lag) && wave_max_counter >= 3) {
+			calculateWave(wave_max_counter - 2); //Half-wave before the last extreme
+		}
+		if (wave_counter == 2 * n_waves && !whole) {
+			return;
+		}
+	}
+	if (wave_max_counter >= 2) {
+		calculateWave(wave_max_counter - 1); //Last half-wave
+	}
 }
 #pragma endregion
 
@@ -183,55 +611,63 @@ bool WaveAnalyser::analyseData() {
 /* Analyse gradients and determine min/max points
 Input: /
 Output: /
+Description: loop over all data points and analyse gradient of each
+*/
+void WaveAnalyser::analyseGradient() {
+	
+	//Loop over acceleration points
+	for (int i = 0; i < A->getLength(); i++) {
+		gradientStep(i);
+	}
+}
+#pragma endregion
+
+#pragma region bool WaveAnalyser::gradientStep(int i)
+/* Analyse gradient of one point
+Input: int i - position, points must be analysed in order
+Output: bool - true if a new extreme was determined
 Description: 
-* Loop over all data points
 * Compute new gradient
 * If gradient has changed, update current gradient and reset gradient counter. Store position of the first point with new direction.
 * If gradient stayed the same increase gradient counter.
 * Check if we have new direction for sufficient number of consecutive points, if yes add new bottom or top.
 */
-void WaveAnalyser::analyseGradient() {
-	
-	//Loop over acceleration points
-	for (int i = 0; i < A->N; i++) {
+bool WaveAnalyser::gradientStep(int i) {
 
-		int new_grad = A->GetGradient(i); //Get new gradient
+	bool extreme = false;
+	int new_grad = A->GetGradient(i); //Get new gradient
 		
-		//Analyse new gradient
-		if (grad != new_grad) 
-		{
-			grad = new_grad; //Update gradient
-			grad_count = 0; //Reset gradient counter
+	//Analyse new gradient
+	if (grad != new_grad) 
+	{
+		grad = new_grad; //Update gradient
+		grad_count = 0; //Reset gradient counter
 
-			//Store starting idx
-			if (grad == 1 || grad == -1) {
-				max_idx[wave_max_counter] = i;
+		//Store starting idx - the previous point if it is more extreme, the gradient lags half a point on average
+		if (grad == 1 || grad == -1) {
+			max_idx[wave_max_counter] = i;
+			if (i > 0 && grad * (A->getElement(i) - A->getElement(i - 1)) > 0) {
+				max_idx[wave_max_counter] = i - 1;
 			}
 		}
-		else
-		{
-			grad_count++; //Increase gradient count
-		}
+	}
+	else
+	{
+		grad_count++; //Increase gradient count
+	}
 
-		//Check if new direction can be determined 
-		if (grad_count == N_GRAD_COUNT && current_grad != grad) {
+	//Check if new direction can be determined 
+	if (grad_count == n_grad_count && current_grad != grad) {
 
-			//New bottom
-			if (current_grad == -1 || current_grad == 1) {
-				//Check if not first local extreme
-				if (wave_max_counter > 0) {
-					//calculate down wave from last top to new bottom
-				}
-				//This is first extreme - just store starting point
-				else {
-					//just update start idx
-				}
-				LOG(2, "Max point: %d", max_idx[wave_max_counter]);
-				wave_max_counter++;
-			}
-			current_grad = grad;
+		//New bottom or top - long decimated records may hold more extremes than max_idx, keep the first ones
+		if ((current_grad == -1 || current_grad == 1) && wave_max_counter < 2 * N_WAVES_MAX - 1) {
+			LOG(2, "Max point: %d", max_idx[wave_max_counter]);
+			wave_max_counter++;
+			extreme = true;
 		}
+		current_grad = grad;
 	}
+	return extreme;
 }
 #pragma endregion
 
@@ -252,43 +688,95 @@ Input: /
 Output: /
 Description: 
 * Check if we have at least two local extremes
-* Loop over maximas.
-* Until sufficient number of waves are analysed, calculate offset of previous and next wave-half.
-* Calculate new displacement of half-wave. 
+* Loop over maximas until sufficient number of waves are analysed.
+*/
+void WaveAnalyser::calculateWaves() {
+
+	//At least one whole wave, loop over maximums
+	for (int i = 1; i < wave_max_counter && wave_counter < 2 * n_waves; i++) {
+		calculateWave(i);
+	}
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::calculateWave(int i)
+/* Calculate height of one half-wave
+Input: int i - index of the extreme at the end of half-wave
+Output: /
+Description: 
+* Calculate offset of previous and next wave-half - the next offset is known when extreme i + 1 is determined.
+* Calculate new displacement of half-wave. In frequency integration mode the array holds heave, height is the difference between extremes.
 * Calculate new half-period. 
 * Increase wave counter.
 */
-void WaveAnalyser::calculateWaves() {
+void WaveAnalyser::calculateWave(int i) {
 
-	//Check we have some waves to analyse
-	if (wave_max_counter <= 1) {
-		// no waves detected
+	//Check if we need more waves
+	if (wave_counter >= 2 * n_waves) {
+		return;
+	}
+
+	//Determine offset
+	old_offset = calculateOffset(max_idx[i - 1], max_idx[i]); //Fist offset
+	if (i < wave_max_counter - 1) {
+		new_offset = calculateOffset(max_idx[i], max_idx[i + 1]);
 	}
 	else {
-		//At least one whole wave, loop over maximums
-		for (int i = 1; i < wave_max_counter; i++) {
-			
-			//Check if we need more waves
-			if (wave_counter < 2 * n_waves) {
-				
-				//Determine offset
-				old_offset = calculateOffset(max_idx[i - 1], max_idx[i]); //Fist offset
-				if (i < wave_max_counter - 1) {
-					new_offset = calculateOffset(max_idx[i], max_idx[i + 1]);
-				}
-				else {
-					new_offset = old_offset;
-				}
+		new_offset = old_offset;
+	}
 
-				height[wave_counter] = A->CalculateDisplacement(max_idx[i - 1], max_idx[i], old_offset, new_offset); //Calculate new height
-				half_period[wave_counter] = A->getHalfPeriod(); //Calculate new period
-				wave_counter++; //Increase wave counter
-			}
-			else {
-				break; //stop calculation
-			}
+	if (integration == INTEGRATE_FREQUENCY) {
+		height[wave_counter] = A->CalculateHeight(max_idx[i - 1], max_idx[i]); //Read new height
+	}
+	else {
+		height[wave_counter] = A->CalculateDisplacement(max_idx[i - 1], max_idx[i], old_offset, new_offset); //Calculate new height
+	}
+	half_period[wave_counter] = A->getHalfPeriod(); //Calculate new period
+	stats.AddHeight(height[wave_counter]); //Update order statistics
+	wave_counter++; //Increase wave counter
+}
+#pragma endregion
+
+#pragma region bool WaveAnalyser::analyseUpcrossing()
+/* Zero-upcrossing wave analysis
+Input: /
+Output: bool - return true if at least n_waves complete waves were analysed, or the record holds no complete wave
+Description:
+* Pass heave in the data array to the zero-upcrossing analysis in one pass, add each finished wave height to order statistics
+* If fewer than n_waves complete waves were found, repeat the record like analyseWaves
+* Average and significant wave height are the mean height and H1/3 of all waves in the record, average period is Tz
+*/
+bool WaveAnalyser::analyseUpcrossing() {
+
+	Z.Init();
+	stats.Init();
+	for (int i = 0; i < A->getLength(); i++) {
+		if (Z.AddElement(A->getElement(i), A->dt)) {
+			LOG(2, "Height: %d, period: %d", (int)(Z.getHeight() * 100), (int)(Z.getPeriod() * 100));
+			stats.AddHeight(Z.getHeight());
 		}
 	}
+	wave_counter = Z.getWaves();
+	if (wave_counter == 0) {
+		LOG(1, "Array full, no waves.");
+		return true;
+	}
+	if (wave_counter < n_waves) {
+		//Repeat scanning
+		init(); //Initialize
+		LOG(1, "Array not full, number of waves: %d", wave_counter);
+		return false;
+	}
+
+	wave_avg = stats.getMean();
+	wave_significant = stats.getH13();
+	period_avg = Z.getTz();
+
+	LOG(1, "UPCROSSING WAVES: %d", wave_counter);
+	LOG(1, "AVERAGE WAVE H: %d", (int)(wave_avg * 100));
+	LOG(1, "SIGNIFICANT WAVE H: %d", (int)(wave_significant * 100));
+	LOG(1, "HMAX: %d, TMAX: %d, TZ: %d", (int)(Z.getHmax() * 100), (int)(Z.getTmax() * 100), (int)(Z.getTz() * 100));
+	return true;
 }
 #pragma endregion
 
@@ -296,26 +784,27 @@ void WaveAnalyser::calculateWaves() {
 /* Analyse wave heights
 Input: /
 Output: bool - return true if sufficient number of waves were analysed, or number of max/min points in one round is less than 2 - no waves. 
+        In streaming and continuous mode the record is never repeated.
 Description: 
 * If sufficient number of waves were detected proceed with analysis.
-* Sort heights by size. 
+* Select the higher half of heights - no full sort is needed. 
 * Calculate average wave height and period. 
-* Determine 2/3 of measurements
+* Select 2/3 of the higher half
 * Calculate average height of waves in correct range - significant height
+* Report order statistics H1/3, H1/10, Hmax and mean of all heights
 */
 bool WaveAnalyser::analyseWaves() {
 
 	//Check if sufficient waves were scanned
 	if (wave_counter == 2 * n_waves) {
 
-		sort(); //Sort height
+		wave_avg = WaveStatistics::SelectTop(height, 2 * n_waves, n_waves); //Move higher half of heights to the front
 		LOG(1, "Heights: ");
 #ifdef SD_CARD
 		logfile = SD.open(filename, FILE_APPEND);
 		logfile.println("Heights:");
 #endif
 		for (int i = 0; i < n_waves; i++) {
-				wave_avg += height[i];
 				period_avg += 2 * half_period[i];
 				LOG(1, "%d", (int)(height[i]*100) );
 #ifdef SD_CARD
@@ -329,6 +818,7 @@ bool WaveAnalyser::analyseWaves() {
 		//Significant wave height
 		int tmp_count = 0;
 		int tmp_end = (int) ((2.0 / 3.0) * (float) n_waves + 1.0);
+		WaveStatistics::SelectTop(height, n_waves, tmp_end); //Move 2/3 of the higher half to the front
 		for (int i = 0; i < tmp_end; i++) {
 			if (height[i] < 10.0 && height[i] < 1.5 * wave_avg) {
 				wave_significant += height[i];
@@ -340,6 +830,8 @@ bool WaveAnalyser::analyseWaves() {
 		LOG(1, "AVERAGE WAVE H: %d", (int)(wave_avg*100));
 		LOG(1, "SIGNIFICANT WAVE H: %d", (int)(wave_significant*100));
 		LOG(1, "AVERAGE PERIOD: %d", (int)(period_avg*100));
+		LOG(1, "H1/3: %d, H1/10: %d, HMAX: %d, HMEAN: %d", (int)(stats.getH13() * 100), (int)(stats.getH110() * 100),
+			(int)(stats.getMax() * 100), (int)(stats.getMean() * 100));
 #ifdef SD_CARD
 		logfile.print("AVERAGE WAVE H: ");
 		logfile.println(wave_avg, 2);
@@ -353,7 +845,7 @@ bool WaveAnalyser::analyseWaves() {
 	}
 	//Else repeat scanning
 	else {
-		if (wave_max_counter <= 2) {
+		if (wave_max_counter <= 2 || streaming || continuous) {
 			//End declare no specific waves
 			LOG(1, "Array full, no waves.");
 #ifdef SD_CARD
@@ -381,37 +873,6 @@ bool WaveAnalyser::analyseWaves() {
 }
 #pragma endregion
 
-#pragma region void WaveAnalyser::sort()
-/* Sort wave height array by size
-Input: /
-Output: /
-Description: sort from largest to smallest
-*/
-void WaveAnalyser::sort() {
-
-	float tmp_height[2 * n_waves]; //Construct tmp array
-	tmp_height[0] = height[0]; //Set first height in first place
-	//Loop over heights
-	for (int i = 1; i < 2 * n_waves; i++) {
-		tmp_height[i] = 0.0;
-		for (int j = 0; j <= i; j++) {
-			if (height[i] > tmp_height[j]) {
-				//Move elements
-				for (int k = i - 1; k >= j; k--) {
-					tmp_height[k + 1] = tmp_height[k];
-				}
-				tmp_height[j] = height[i];
-				break;
-			}
-		}
-	}
-	//Copy back
-	for (int i = 0; i < 2 * n_waves; i++) {
-		height[i] = tmp_height[i];
-	}
-}
-#pragma endregion
-
 // SET FUNCTIONS
 
 #pragma region void WaveAnalyser::setCalibrationDelay(int newDelay)
@@ -422,6 +883,9 @@ void WaveAnalyser::sort() {
 void WaveAnalyser::setCalibrationDelay(int newDelay) {
 	if (newDelay > 0 && newDelay < 200000) {
 		calibration_delay = newDelay;
+		if (!verify) {
+			wait_delay = calibration_delay;
+		}
 	}
 }
 #pragma endregion
@@ -438,8 +902,230 @@ void WaveAnalyser::setNumberOfWaves(int newNumber) {
 }
 #pragma endregion
 
+#pragma region void WaveAnalyser::setWelchRecord(unsigned long record)
+/* Set Welch spectrum record time
+Input: unsigned long record - record time in millis, 0 disables Welch spectrum
+Output: /
+Description: allocate Welch accumulator on first use. Acquisition continues after time-domain analysis until the record is complete.
+*/
+void WaveAnalyser::setWelchRecord(unsigned long record) {
+	welch_record = record;
+	if (welch_record > 0 && !W) {
+		W = new WelchPSD(WELCH_SEGMENT, max(1, WELCH_DECIMATION / decimation)); //Decimation stage already reduced the rate
+	}
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::setDirectionalRecord(unsigned long record)
+/* Set directional record time
+Input: unsigned long record - record time in millis, 0 disables directional analysis
+Output: /
+Description:
+* Allocate directional accumulator on first use. Horizontal accelerations are not decimated by the decimation stage,
+  all three are block-averaged at the sensor rate.
+* Acquisition continues after time-domain analysis until the record is complete.
+* The sensor rotates all three axes only while directional analysis is enabled.
+*/
+void WaveAnalyser::setDirectionalRecord(unsigned long record) {
+	directional_record = record;
+	mpu.setFullRotation(directional_record > 0);
+	if (directional_record > 0 && !DS) {
+		DS = new DirectionalSpectrum();
+	}
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::setIntegration(int method, float f_cut)
+/* Set integration method
+Input: int method - INTEGRATE_TIME or INTEGRATE_FREQUENCY, float f_cut - lowest frequency kept in frequency domain integration, Hz
+Output: /
+Description: frequency domain integration needs the data array, it is not available in streaming and continuous mode.
+             The array is zero padded to the next power of 2, heap storage is enlarged here.
+             Zero-upcrossing detection always uses frequency domain integration.
+*/
+void WaveAnalyser::setIntegration(int method, float f_cut) {
+	if ((method == INTEGRATE_FREQUENCY || detection == DETECT_UPCROSSING) && !streaming && !continuous) {
+		integration = INTEGRATE_FREQUENCY;
+		if (!A->Reserve(A->PaddedLength())) {
+			LOG(1, "No storage for zero padding, part of array is integrated.");
+		}
+	}
+	else {
+		integration = INTEGRATE_TIME;
+	}
+	if (f_cut > 0.0) {
+		integration_cutoff = f_cut;
+	}
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::setDetection(int method)
+/* Set wave detection method
+Input: int method - DETECT_GRADIENT or DETECT_UPCROSSING
+Output: /
+Description:
+* Zero-upcrossing detection works on heave, so it enables frequency domain integration of the data array. It is not
+  available in streaming and continuous mode.
+* Wave is the record between two upcrossings - average and significant wave height become the mean height and H1/3
+  of all waves in the record, average period becomes Tz. A record with fewer than the number of waves to measure is repeated.
+*/
+void WaveAnalyser::setDetection(int method) {
+	if (method == DETECT_UPCROSSING && !streaming && !continuous) {
+		detection = DETECT_UPCROSSING;
+		setIntegration(INTEGRATE_FREQUENCY, 0.0);
+	}
+	else {
+		detection = DETECT_GRADIENT;
+	}
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::setContinuous(float overlap)
+/* Enable continuous acquisition
+Input: float overlap - overlap of neighbouring analysis windows, fraction between 0 and 0.9
+Output: /
+Description:
+* Data array becomes a ring, data is filtered on arrival and a window of n_data_array elements is analysed every
+  (1 - overlap) * n_data_array elements. update() returns true after each window and acquisition continues,
+  call setup() only once.
+* Analysis of filtered ring is read-only - zero-phase filtering, frequency domain integration, single record spectrum
+  and Welch spectrum are not used. Not available in streaming mode.
+* A window is analysed in steps over update() calls, samples that arrive meanwhile are added to the ring after it.
+  Use FIFO acquisition to keep samples over longer blocking calls in the main loop.
+*/
+void WaveAnalyser::setContinuous(float overlap) {
+	if (streaming) {
+		return;
+	}
+	continuous = true;
+	integration = INTEGRATE_TIME;
+	detection = DETECT_GRADIENT;
+	A->SetContinuous(overlap);
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::setZeroPhase(bool enable)
+/* Enable or disable zero-phase filtering
+Input: bool enable
+Output: /
+Description: forward-backward filtering removes the phase lag of extremes and doubles the attenuation, so a lower
+             filter order can be used. It needs the whole record, it is not available in streaming mode.
+*/
+void WaveAnalyser::setZeroPhase(bool enable) {
+	zero_phase = enable && !streaming;
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::setSpectralAnalysis(bool enable)
+/* Enable or disable spectral analysis
+Input: bool enable
+Output: /
+Description: disabled by default. Single record spectral analysis overwrites the data array and costs an FFT per cycle.
+             It needs the data array, so it is not available in streaming mode - use Welch spectrum instead
+*/
+void WaveAnalyser::setSpectralAnalysis(bool enable) {
+	spectral = enable;
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::setFifo(bool enable)
+/* Enable or disable FIFO acquisition
+Input: bool enable
+Output: /
+Description: sensor buffers samples at a fixed rate and they are read in bursts, so the MCU can sleep for getIdleTime()
+             between them. Call after setup(), the setting is kept over sensor sleep.
+*/
+void WaveAnalyser::setFifo(bool enable) {
+	mpu.setFifo(enable);
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::setInterrupt(bool enable)
+/* Enable or disable data-ready interrupt acquisition
+Input: bool enable
+Output: /
+Description: sensor is read only after its INT pin ISR called dataReady(), so the MCU can sleep for getIdleTime()
+             between samples. Call after setup(), not used with FIFO acquisition.
+*/
+void WaveAnalyser::setInterrupt(bool enable) {
+	mpu.setInterrupt(enable);
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::setMasterRead(bool enable)
+/* Enable or disable master read mode
+Input: bool enable
+Output: /
+Description: sensor's internal I2C master reads the magnetometer, so each sample is read with one I2C transaction.
+             Call after setup().
+*/
+void WaveAnalyser::setMasterRead(bool enable) {
+	mpu.setMasterRead(enable);
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::setAsync(bool enable)
+/* Enable or disable non-blocking sensor reads
+Input: bool enable
+Output: /
+Description: sensor burst is read in the background while the analysis computes, master read mode is enabled with it.
+             Call after setup().
+*/
+void WaveAnalyser::setAsync(bool enable) {
+	mpu.setAsync(enable);
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::setIMU(bool enable)
+/* Enable or disable six-axis fusion
+Input: bool enable
+Output: /
+Description: magnetometer is powered down for heave-only measurements, heading is not valid for directional analysis.
+             Call after setup().
+*/
+void WaveAnalyser::setIMU(bool enable) {
+	if (enable && DS) {
+		LOG(1, "Six-axis fusion has no heading, wave direction is not valid");
+	}
+	mpu.setIMU(enable);
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::setBiasEstimation(bool enable)
+/* Enable or disable online bias estimation
+Input: bool enable
+Output: /
+Description: sensor biases are tracked in the fusion loop after convergence and kept in EEPROM, enabled by default
+*/
+void WaveAnalyser::setBiasEstimation(bool enable) {
+	mpu.setBiasEstimation(enable);
+}
+#pragma endregion
+
+#pragma region void WaveAnalyser::setMagCalibration(bool enable)
+/* Enable or disable streaming magnetometer calibration
+Input: bool enable
+Output: /
+Description: hard- and soft-iron are fitted during normal operation, enabled by default
+*/
+void WaveAnalyser::setMagCalibration(bool enable) {
+	mpu.setMagCalibration(enable);
+}
+#pragma endregion
+
+void WaveAnalyser::dataReady() {
+	mpu.dataReady();
+}
+
 // GET FUNCTIONS
 
+unsigned long WaveAnalyser::getIdleTime() {
+	if (window_busy) {
+		return 0; //Window analysis in progress
+	}
+	return mpu.getIdleTime();
+}
+
 float WaveAnalyser::getSignificantWave() {
 	return wave_significant;
 };
@@ -451,3 +1137,59 @@ float WaveAnalyser::getAverageWave() {
 float WaveAnalyser::getAveragePeriod() {
 	return period_avg;
 };
+
+float WaveAnalyser::getHm0() {
+	return spectrum.getHm0();
+};
+
+float WaveAnalyser::getTp() {
+	return spectrum.getTp();
+};
+
+float WaveAnalyser::getTm01() {
+	return spectrum.getTm01();
+};
+
+float WaveAnalyser::getTm02() {
+	return spectrum.getTm02();
+};
+
+float WaveAnalyser::getH13() {
+	return stats.getH13();
+};
+
+float WaveAnalyser::getH110() {
+	return stats.getH110();
+};
+
+float WaveAnalyser::getHmax() {
+	return stats.getMax();
+};
+
+float WaveAnalyser::getHmean() {
+	return stats.getMean();
+};
+
+float WaveAnalyser::getTz() {
+	return Z.getTz();
+};
+
+float WaveAnalyser::getTmax() {
+	return Z.getTmax();
+};
+
+uint8_t WaveAnalyser::getQC() {
+	return continuous ? qc_window : qc.getFlags();
+};
+
+float WaveAnalyser::getMeanDirection() {
+	return DS ? DS->getMeanDirection() : 0.0;
+};
+
+float WaveAnalyser::getPeakDirection() {
+	return DS ? DS->getPeakDirection() : 0.0;
+};
+
+float WaveAnalyser::getDirectionalSpread() {
+	return DS ? DS->getSpread() : 0.0;
+};
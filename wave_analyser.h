@@ -5,6 +5,15 @@
 #include <Arduino.h>
 #include "array_structures.h" //Quaternion and vector classes
 #include "MPU9250.h" //Sensor library
+#include "wave_stream.h" //One-pass wave analysis
+#include "wave_spectrum.h" //Spectral wave parameters
+#include "welch_psd.h" //Welch spectrum during acquisition
+#include "wave_statistics.h" //Height order statistics
+#include "decimator.h" //Anti-alias filter and downsampling
+#include "static_motion_array.h" //Compile-time specialised data array
+#include "directional_spectrum.h" //Directional wave parameters
+#include "zero_crossing.h" //Zero-upcrossing wave analysis
+#include "data_quality.h" //Quality control of samples
 #include <stdarg.h>
 //#include "SD.h" - add for ESP32 to use SD logging
 //#include "FS.h" - add for ESP32 to use SD logging
@@ -17,8 +26,19 @@
 #define N_GRAD 50  //Distance for gradient calculation
 #define N_GRAD_COUNT 20 //Number of points with the same gradient to consider as new direction
 #define N_WAVES_MAX 50 //Max number of waves to calculate - defines array length (increase if needed)
+#define STATISTICS_CAPACITY ((2 * N_WAVES_MAX + 2) / 3) //Number of kept largest heights - highest third of 2 * N_WAVES_MAX half-waves
 #define N_WAVES 5 //Initial number of waves to calculate - can be adjusted by the user
 #define INNITAL_CALIBRATION_DELAY 120000 //Delay for quaternions calculations to calibrate
+#define WARM_START_DELAY 5000 //Verification delay after warm start of quaternions
+#define WARM_START_MAX_TILT 10.0 //Max mean tilt error in degrees to accept warm start
+#define N_STREAM_MAX 18000 //Max number of samples to stream before giving up, in streaming mode
+#define CONTINUOUS_OVERLAP 0.5 //Default overlap of analysis windows in continuous mode
+#define WINDOW_PENDING 64 //Samples buffered while a window is analysed in continuous mode
+#define QC_HOPS_MAX 12 //Max number of hops of one window in continuous mode, with overlap up to 0.9
+#define INTEGRATE_TIME 0 //Half-wave heights by double integration in time domain
+#define INTEGRATE_FREQUENCY 1 //Heave by double integration in frequency domain
+#define DETECT_GRADIENT 0 //Half-waves between extremes of the gradient
+#define DETECT_UPCROSSING 1 //Waves between zero-upcrossings of heave
 
 //#define SD_CARD //If using ESP32 and want to use SD card logging uncomment
 
@@ -28,7 +48,9 @@ public:
 	
 	//WaveAnalyser(); 
 	WaveAnalyser(float cutoff_freq = CUTOFF_FREQ, float sampling_time = SAMPLING_TIME, int order = INIT_ORDER, int n_data_array = N_DATA_ARRAY,
-		int n_grad = N_GRAD, int innitial_calibration_delay = INNITAL_CALIBRATION_DELAY, int n_w = N_WAVES); //Constructor with default parameters
+		int n_grad = N_GRAD, int innitial_calibration_delay = INNITAL_CALIBRATION_DELAY, int n_w = N_WAVES, bool stream = false,
+		int decimation = 1); //Constructor with default parameters
+	WaveAnalyser(MotionArray *array, int innitial_calibration_delay = INNITAL_CALIBRATION_DELAY, int n_w = N_WAVES); //Constructor with given data array, e.g. StaticMotionArray
 	void init(); //Initialization
 	void setup(); //Setup
 	bool update(); //Update reading - call every time from the main loop
@@ -36,14 +58,74 @@ public:
 	//Set function
 	void setCalibrationDelay(int); //Change calibration delay after initialization
 	void setNumberOfWaves(int); //Change number of waves to be measured after initialization
+	void setSpectralAnalysis(bool); //Enable or disable spectral analysis of the data array
+	void setWelchRecord(unsigned long); //Set Welch spectrum record time in millis, 0 disables it
+	void setIntegration(int, float f_cut = INTEGRATION_CUTOFF); //Set integration method and its low frequency cutoff in Hz
+	void setZeroPhase(bool); //Enable or disable zero-phase forward-backward filtering of the data array
+	void setContinuous(float overlap = CONTINUOUS_OVERLAP); //Acquire continuously and analyse overlapping windows
+	void setDirectionalRecord(unsigned long); //Set directional record time in millis, 0 disables it
+	void setDetection(int); //Set wave detection method
+	void setFifo(bool); //Enable or disable FIFO burst acquisition of the sensor
+	void setInterrupt(bool); //Enable or disable data-ready interrupt acquisition of the sensor
+	void setMasterRead(bool); //Enable or disable single burst 9-axis reads of the sensor
+	void setAsync(bool); //Enable or disable non-blocking reads of the sensor
+	void setIMU(bool); //Enable or disable six-axis fusion without magnetometer
+	void setBiasEstimation(bool); //Enable or disable online gyro and accelometer bias estimation
+	void setMagCalibration(bool); //Enable or disable streaming magnetometer calibration
+	void dataReady(); //Sensor data-ready interrupt - call from the INT pin ISR
+	unsigned long getIdleTime(); //Millis the MCU can sleep before new sensor data
 	float getSignificantWave(); 
 	float getAverageWave();
 	float getAveragePeriod();
+	float getHm0(); //Spectral significant wave height
+	float getTp(); //Spectral peak period
+	float getTm01(); //Spectral mean period
+	float getTm02(); //Spectral mean zero-crossing period
+	float getH13(); //Mean of the highest third of heights
+	float getH110(); //Mean of the highest tenth of heights
+	float getHmax(); //Highest height
+	float getHmean(); //Mean of all heights
+	float getTz(); //Mean zero-upcrossing period
+	float getTmax(); //Period of the highest zero-upcrossing wave
+	float getMeanDirection(); //Mean wave direction in degrees from north, where waves come from
+	float getPeakDirection(); //Wave direction at the spectral peak in degrees from north
+	float getDirectionalSpread(); //Mean directional spread in degrees
+	uint8_t getQC(); //Quality control flags of the record, or of the last window in continuous mode
 
 private:
 
 	MPU9250 mpu; //MPU9250 sensor
-	MotionArray *A; //Filtered acceleration data array
+	DataQuality qc; //Quality control of samples
+	uint8_t qc_window = 0; //Quality control flags of the last window in continuous mode
+	uint8_t qc_hops[QC_HOPS_MAX]; //Quality control flags of the last hops in continuous mode, ring
+	int qc_hop = 0; //Next position in qc_hops
+	MotionArray *A; //Filtered acceleration data array - NULL in streaming mode
+	WaveStream *S; //One-pass wave analysis - NULL in batch mode
+	Decimator *D = NULL; //Decimation stage - NULL without decimation
+	int decimation = 1; //Decimation factor
+	int n_grad_count = N_GRAD_COUNT; //Number of decimated points with the same gradient to consider as new direction
+	bool streaming = false; //Denotes streaming mode
+	WaveSpectrum spectrum; //Spectral analysis of the data array
+	bool spectral = false; //Denotes if spectral analysis is enabled
+	WelchPSD *W = NULL; //Welch spectrum accumulator - NULL when disabled
+	unsigned long welch_record = 0; //Welch record time in millis
+	bool welch_done = false; //Denotes if Welch record is complete
+	DirectionalSpectrum *DS = NULL; //Directional spectrum accumulator - NULL when disabled
+	unsigned long directional_record = 0; //Directional record time in millis
+	bool directional_done = false; //Denotes if directional record is complete
+	bool waves_done = false; //Denotes if time-domain analysis is complete
+	int integration = INTEGRATE_TIME; //Integration method
+	float integration_cutoff = INTEGRATION_CUTOFF; //Lowest frequency kept in frequency domain integration
+	bool zero_phase = false; //Denotes forward-backward filtering
+	bool continuous = false; //Denotes continuous acquisition
+	bool window_busy = false; //Denotes window analysis in progress in continuous mode
+	int window_pos = 0; //Next point of the window to analyse
+	int window_step = 1; //Points of the window analysed per update() call
+	int16_t pending_x[WINDOW_PENDING]; //Samples that arrived during window analysis
+	float pending_dt[WINDOW_PENDING];
+	int n_pending = 0; //Number of pending samples
+	int detection = DETECT_GRADIENT; //Wave detection method
+	ZeroCrossing Z; //Zero-upcrossing analysis of heave
 
 	bool full = false; //Denotes if data array is full
 	int grad = 0; //Current motion gradient
@@ -53,6 +135,7 @@ private:
 	int max_idx[2 * N_WAVES_MAX]; //Indices of local maximums and minimums
 	float height[2 * N_WAVES_MAX]; //Measured heights
 	float half_period[2 * N_WAVES_MAX]; //Measured half-periods
+	WaveStatistics stats{ STATISTICS_CAPACITY }; //Order statistics of measured heights
 	int wave_max_counter = 0; //Maximum counter
 	int wave_counter = 0; //Wave counter
 
@@ -62,18 +145,34 @@ private:
 	int wait_time; 
 	int print_wait_time = 0; 
 	int calibration_delay; //Initial delay time for calculations calibration
+	int wait_delay; //Current delay - calibration or warm start verification
+	bool verify = false; //Denotes warm start verification
+	bool calibrated = false; //Denotes end of calibration - delay passed or quaternions converged
+	float tilt_sum = 0.0; //Sum of tilt errors during verification
+	int tilt_n = 0; //Number of tilt errors
 
 	int n_waves; //Number of waves to measure 
 	float wave_avg = 0.0; //Last average wave height
 	float wave_significant = 0.0;
 	float period_avg = 0.0;
 
+	bool analyseSample(int16_t, float, bool);
 	bool analyseData();
+	void startWindow();
+	bool stepWindow(int);
+	void flushPending();
+	void resetWaves();
+	bool analyseStream(int16_t, float);
+	bool analyseWelch(int16_t, float);
+	bool analyseDirection(int16_t, int16_t, int16_t, float);
+	void analyseFused();
 	void analyseGradient();
+	bool gradientStep(int);
 	bool analyseWaves();
+	bool analyseUpcrossing();
 	int16_t calculateOffset(int, int);
 	void calculateWaves();
-	void sort();
+	void calculateWave(int);
 
 	//SD card logging
 	//File logfile;
@@ -0,0 +1,151 @@
+#include "wave_spectrum.h"
+
+#pragma region WaveSpectrum::WaveSpectrum(float f_min, float f_max)
+/* WaveSpectrum constructor
+Input: float f_min, float f_max - frequency band used for spectral moments
+*/
+WaveSpectrum::WaveSpectrum(float f_min, float f_max) {
+	F_min = f_min;
+	F_max = f_max;
+	Init();
+}
+#pragma endregion
+
+#pragma region void WaveSpectrum::Init()
+/* Initialization
+Input: /
+Output: /
+Description: reset spectral moments
+*/
+void WaveSpectrum::Init() {
+	m0 = 0.0;
+	m1 = 0.0;
+	m2 = 0.0;
+	s_peak = 0.0;
+	f_peak = 0.0;
+}
+#pragma endregion
+
+#pragma region bool WaveSpectrum::Analyse(int16_t *x, int n, float dt, bool heave)
+/* Calculate heave spectrum and spectral moments
+Input: int16_t *x - acceleration record in mg or heave record in mm, int n - length of record, float dt - sampling time in s,
+       bool heave - record holds heave
+Output: bool - true if the spectrum was calculated
+Description:
+* Use the longest power of 2 length, that fits into the record
+* Remove mean value and apply Hann window, both in integers
+* Scale data to full Q15 range and calculate real FFT in place - the record is overwritten
+* Calculate one-sided density 2 |X|^2 dt / (n U) for each bin in the frequency band, U is the window power
+* Convert acceleration density to heave density and add it to the spectral moments
+*/
+bool WaveSpectrum::Analyse(int16_t *x, int n, float dt, bool heave) {
+
+	Init();
+
+	int len = 1;
+	while (2 * len <= n && 2 * len <= FFT_MAX) {
+		len *= 2;
+	}
+	if (len < 16 || dt <= 0.0) {
+		return false;
+	}
+
+	//Remove mean
+	int32_t sum = 0;
+	for (int i = 0; i < len; i++) {
+		sum += x[i];
+	}
+	int16_t mean = (int16_t)(sum / len);
+
+	//Hann window
+	for (int i = 0; i < len; i++) {
+		int16_t w = (int16_t)((32767 - FixedFFT::Cos(i, len)) >> 1);
+		x[i] = FixedFFT::Multiply(x[i] - mean, w);
+	}
+
+	int exponent = FixedFFT::Normalize(x, len);
+	exponent += FixedFFT::Real(x, len);
+
+	float df = 1.0 / ((float)len * dt);
+	float unit = heave ? 0.001 : GRAV_CONSTANT / 1000.0; //mm or mg to SI
+	float scale = ldexpf(1.0, 2 * exponent) * unit * unit * 2.0 * dt / ((float)len * HANN_POWER);
+
+	for (int k = 1; k < len / 2 && (float)k * df <= F_max; k++) {
+		float re = (float)x[2 * k];
+		float im = (float)x[2 * k + 1];
+		float s = (re * re + im * im) * scale;
+		addBin((float)k * df, heave ? s : toHeave((float)k * df, s), df);
+	}
+
+	LOG(1, "SPECTRUM: N %d, m0 %d mm^2", len, (int)(m0 * 1000000.0));
+	return true;
+}
+#pragma endregion
+
+#pragma region bool WaveSpectrum::AnalysePSD(float *psd, int n, float df)
+/* Calculate spectral moments from a power spectral density
+Input: float *psd - one-sided acceleration density in (m/s^2)^2/Hz from 0 Hz, int n - number of bins, float df - bin width in Hz
+Output: bool - true if the moments were calculated
+*/
+bool WaveSpectrum::AnalysePSD(float *psd, int n, float df) {
+
+	Init();
+	if (df <= 0.0) {
+		return false;
+	}
+	for (int k = 1; k < n; k++) {
+		addBin((float)k * df, toHeave((float)k * df, psd[k]), df);
+	}
+	return true;
+}
+#pragma endregion
+
+#pragma region void WaveSpectrum::addBin(float f, float s, float df)
+/* Add spectral density bin to the moments
+Input: float f - frequency, float s - heave density in m^2/Hz, float df - bin width
+Output: /
+Description: skip bins outside the frequency band
+*/
+void WaveSpectrum::addBin(float f, float s, float df) {
+	if (f < F_min || f > F_max) {
+		return;
+	}
+
+	m0 += s * df;
+	m1 += f * s * df;
+	m2 += f * f * s * df;
+	if (s > s_peak) {
+		s_peak = s;
+		f_peak = f;
+	}
+}
+#pragma endregion
+
+#pragma region float WaveSpectrum::toHeave(float f, float s)
+/* Convert acceleration density to heave density
+Input: float f - frequency, float s - acceleration density in (m/s^2)^2/Hz
+Output: float - heave density in m^2/Hz, divided by (2 PI f)^4
+*/
+float WaveSpectrum::toHeave(float f, float s) {
+	float w = 2.0 * PI * f;
+	return s / (w * w * w * w);
+}
+#pragma endregion
+
+// GET FUNCTIONS
+
+float WaveSpectrum::getHm0() {
+	return 4.0 * sqrt(m0);
+}
+
+float WaveSpectrum::getTp() {
+	return (f_peak > 0.0) ? 1.0 / f_peak : 0.0;
+}
+
+float WaveSpectrum::getTm01() {
+	return (m1 > 0.0) ? m0 / m1 : 0.0;
+}
+
+float WaveSpectrum::getTm02() {
+	return (m2 > 0.0) ? sqrt(m0 / m2) : 0.0;
+}
@@ -0,0 +1,46 @@
+/* WAVE SPECTRUM class - spectral wave parameters used in the wave_analyser.h library
+* Heave spectrum is calculated from the filtered acceleration record with the fixed point FFT (fixed_fft.h).
+* Acceleration spectrum is divided by (2 PI f)^4 to get the heave spectrum, a heave record integrated in the
+* frequency domain (MotionArray::IntegrateDisplacement) is used directly. Spectral moments m0, m1 and m2 give:
+* Hm0 = 4 sqrt(m0), Tm01 = m0 / m1, Tm02 = sqrt(m0 / m2), and Tp = 1 / f of the spectral peak.
+*/
+
+#ifndef _WAVE_SPECTRUM_H_
+#define _WAVE_SPECTRUM_H_
+
+#include <Arduino.h>
+#include "fixed_fft.h" //Q15 FFT
+#include "array_structures.h" //GRAV_CONSTANT and debug logging
+
+#define SPECTRUM_F_MIN 0.05 //Lowest frequency used in spectral moments, Hz - longer periods are dominated by integrated noise
+#define SPECTRUM_F_MAX 0.5 //Highest frequency used in spectral moments, Hz
+
+class WaveSpectrum {
+public:
+
+	WaveSpectrum(float f_min = SPECTRUM_F_MIN, float f_max = SPECTRUM_F_MAX); //Constructor
+	void Init(); //Initialization
+	bool Analyse(int16_t *x, int n, float dt, bool heave = false); //Calculate spectrum of acceleration record in mg, or heave record in mm - data is overwritten!
+	bool AnalysePSD(float *psd, int n, float df); //Calculate moments from acceleration density bins in (m/s^2)^2/Hz
+
+	float getHm0(); //Spectral significant wave height in m
+	float getTp(); //Peak period in s
+	float getTm01(); //Mean period in s
+	float getTm02(); //Mean zero-crossing period in s
+
+private:
+
+	float F_min; //Frequency band of spectral moments
+	float F_max;
+
+	float m0 = 0.0; //Spectral moments
+	float m1 = 0.0;
+	float m2 = 0.0;
+	float s_peak = 0.0; //Peak spectral density
+	float f_peak = 0.0; //Peak frequency
+
+	void addBin(float f, float s, float df); //Add heave spectral density bin to the moments
+	float toHeave(float f, float s); //Convert acceleration density to heave density
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include "wave_statistics.h"
+
+#pragma region WaveStatistics::WaveStatistics(int capacity)
+/* WaveStatistics constructor
+Input: int capacity - number of kept largest heights
+*/
+WaveStatistics::WaveStatistics(int capacity) {
+	K = max(1, capacity);
+	heap = (float *)malloc((K)*sizeof(float));
+	Init();
+}
+#pragma endregion
+
+#pragma region void WaveStatistics::Init()
+/* Initialization
+Input: /
+Output: /
+Description: empty the heap and reset counters
+*/
+void WaveStatistics::Init() {
+	size = 0;
+	count = 0;
+	sum = 0.0;
+	h_max = 0.0;
+}
+#pragma endregion
+
+#pragma region void WaveStatistics::AddHeight(float h)
+/* Add new height
+Input: float h - height
+Output: /
+Description:
+* Update count, sum and maximum
+* While heap is not full, add height at the end and move it up
+* Else replace the root, if the new height is larger, and move it down
+*/
+void WaveStatistics::AddHeight(float h) {
+
+	count++;
+	sum += h;
+	if (h > h_max) {
+		h_max = h;
+	}
+
+	if (size < K) {
+		int i = size++;
+		while (i > 0 && heap[(i - 1) / 2] > h) {
+			heap[i] = heap[(i - 1) / 2]; //Move parent down
+			i = (i - 1) / 2;
+		}
+		heap[i] = h;
+	}
+	else if (h > heap[0]) {
+		heap[0] = h;
+		siftDown(0);
+	}
+}
+#pragma endregion
+
+#pragma region float WaveStatistics::getTopMean(int m)
+/* Mean of the highest heights
+Input: int m - number of heights
+Output: float - mean of m highest heights, limited to heap size
+Description: select m largest heights in the heap, then restore the heap
+*/
+float WaveStatistics::getTopMean(int m) {
+
+	m = min(m, size);
+	if (m <= 0) {
+		return 0.0;
+	}
+	float top = SelectTop(heap, size, m);
+
+	//Restore heap
+	for (int i = size / 2 - 1; i >= 0; i--) {
+		siftDown(i);
+	}
+	return top / (float)m;
+}
+#pragma endregion
+
+#pragma region float WaveStatistics::SelectTop(float *a, int n, int m)
+/* Select largest elements
+Input: float *a - array, int n - length of array, int m - number of largest elements
+Output: float - sum of m largest elements
+Description:
+* Quickselect with median of three pivot - partition range in descending order until the m-th position is in place
+* Only the range which contains the m-th position is partitioned further, expected time is linear
+* The m largest elements are at the front of array afterwards, in no particular order
+*/
+float WaveStatistics::SelectTop(float *a, int n, int m) {
+
+	m = min(m, n);
+	int lo = 0;
+	int hi = n - 1;
+	while (lo < hi && m > lo && m <= hi) {
+
+		//Median of three pivot
+		int mid = lo + (hi - lo) / 2;
+		float p0 = a[lo], p1 = a[mid], p2 = a[hi];
+		float pivot = max(min(p0, p1), min(max(p0, p1), p2));
+
+		//Partition - larger elements first
+		int i = lo;
+		int j = hi;
+		while (i <= j) {
+			while (a[i] > pivot) { i++; }
+			while (a[j] < pivot) { j--; }
+			if (i <= j) {
+				float tmp = a[i];
+				a[i] = a[j];
+				a[j] = tmp;
+				i++;
+				j--;
+			}
+		}
+
+		//Continue in the part which holds position m
+		if (m <= j) {
+			hi = j;
+		}
+		else if (m >= i) {
+			lo = i;
+		}
+		else {
+			break; //Elements between j and i are equal to pivot
+		}
+	}
+
+	float top = 0.0;
+	for (int k = 0; k < m; k++) {
+		top += a[k];
+	}
+	return top;
+}
+#pragma endregion
+
+#pragma region void WaveStatistics::siftDown(int i)
+/* Move heap element down to its position */
+void WaveStatistics::siftDown(int i) {
+	float h = heap[i];
+	while (2 * i + 1 < size) {
+		int c = 2 * i + 1;
+		if (c + 1 < size && heap[c + 1] < heap[c]) {
+			c++; //Smaller child
+		}
+		if (heap[c] >= h) {
+			break;
+		}
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = h;
+}
+#pragma endregion
+
+// GET FUNCTIONS
+
+int WaveStatistics::getCount() {
+	return count;
+}
+
+float WaveStatistics::getMean() {
+	return (count > 0) ? sum / (float)count : 0.0;
+}
+
+float WaveStatistics::getMax() {
+	return h_max;
+}
+
+float WaveStatistics::getH13() {
+	return getTopMean(max(1, count / 3));
+}
+
+float WaveStatistics::getH110() {
+	return getTopMean(max(1, count / 10));
+}
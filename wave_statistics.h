@@ -0,0 +1,42 @@
+/* WAVE STATISTICS class - height order statistics used in the wave_analyser.h library
+* Heights are added one by one as they are measured. Count, sum and the largest heights are kept in a bounded
+* min-heap of top heights, the smallest kept height is at the root and is replaced when a larger height arrives.
+* H1/3 and H1/10 are means of the highest third and tenth of heights. They are exact while the highest third
+* fits into the heap, longer records use the heap only.
+* Selection of the largest heights in linear expected time is also available for arrays - SelectTop().
+*/
+
+#ifndef _WAVE_STATISTICS_H_
+#define _WAVE_STATISTICS_H_
+
+#include <Arduino.h>
+
+class WaveStatistics {
+public:
+
+	WaveStatistics(int capacity); //Constructor with number of kept largest heights
+	void Init(); //Initialization
+	void AddHeight(float h); //Add new height
+
+	int getCount(); //Number of added heights
+	float getMean(); //Mean height
+	float getMax(); //Highest height
+	float getH13(); //Mean of the highest third of heights
+	float getH110(); //Mean of the highest tenth of heights
+	float getTopMean(int m); //Mean of the m highest heights
+
+	static float SelectTop(float *a, int n, int m); //Move m largest elements to the front, return their sum
+
+private:
+
+	float *heap; //Min-heap of largest heights
+	int K; //Heap capacity
+	int size = 0; //Number of heights in the heap
+	int count = 0; //Number of added heights
+	float sum = 0.0; //Sum of all heights
+	float h_max = 0.0; //Highest height
+
+	void siftDown(int i);
+};
+
+#endif
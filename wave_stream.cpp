@@ -0,0 +1,232 @@
+#include "wave_stream.h"
+
+#pragma region WaveStream::WaveStream()
+/* WaveStream constructor
+Input:
+* int n_grad - distance for the gradient calculation
+* int n_grad_count - number of points with the same gradient to consider as new direction
+* float cutoff_freq - cutoff frequency for the low-pass filter
+* float sampling_time - predicted sampling time of the IMU
+* int order - order of the low-pass filter, between 1 and 4
+Description:
+* Construct look-ahead ring - it must hold the gradient span, the extremum confirmation delay and the point before extremum
+* Define low-pass filter
+*/
+WaveStream::WaveStream(int n_grad, int n_grad_count, float cutoff_freq, float sampling_time, int order) {
+
+	N_gradient = n_grad;
+	N_gradient_count = n_grad_count;
+	N_ring = max(2 * N_gradient, N_gradient + N_gradient_count + 1) + 1;
+
+	ring = (int16_t *)malloc((N_ring)*sizeof(int16_t));
+
+	//Initialize filter
+	if (order < 1 || order > BIQUAD_MAX_ORDER) { order = 3; } //Low pass filter order
+	filter = new Biquad(cutoff_freq, sampling_time, order); //Define low-pass filter
+
+	Init();
+}
+#pragma endregion
+
+#pragma region void WaveStream::Init()
+/* Initialization
+Input: /
+Output: /
+Description: initialize ring, counters and half-wave accumulators
+*/
+void WaveStream::Init() {
+	for (int i = 0; i < N_ring; i++) {
+		ring[i] = 0;
+	}
+	n_elements = 0;
+	dt_sum = 0.0;
+	x_first = 0;
+	grad = 0;
+	current_grad = 0;
+	grad_count = 0;
+	extremes = 0;
+	started = false;
+	pending = false;
+	height = 0.0;
+	half_period = 0.0;
+	filter->init();
+}
+#pragma endregion
+
+#pragma region bool WaveStream::AddElement(int16_t _x, float _dt)
+/* Add new element
+Input: int16_t _x - new acceleration, float _dt - new time interval
+Output: bool - true when a new half-wave height and period are ready
+Description:
+* Filter the new sample and store it into the ring
+* Calculate gradient of the sample N_gradient positions back - the same as MotionArray::GetGradient
+* Update gradient counters the same way as WaveAnalyser::analyseGradient
+* Integrate the sample N_gradient_count positions behind the gradient point, which is where a confirmed extreme lies
+* The extreme is moved to the previous sample if it is more extreme, the same as WaveAnalyser::gradientStep - that sample
+  already closes the current half-wave
+*/
+bool WaveStream::AddElement(int16_t _x, float _dt) {
+
+	int16_t xf = _x;
+	filter->process(&xf, &xf, 1);
+	ring[n_elements % N_ring] = xf;
+	if (n_elements == 0) {
+		x_first = xf;
+	}
+	n_elements++;
+	dt_sum += _dt;
+
+	//Gradient point needs N_gradient samples of look-ahead
+	long i = n_elements - 1 - N_gradient;
+	if (i < 0) {
+		return false;
+	}
+
+	int16_t x_min = (i - N_gradient < 0) ? x_first : getRing(i - N_gradient);
+	int16_t x_max = getRing(i + N_gradient);
+	int new_grad = (x_max > x_min) ? 1 : ((x_max < x_min) ? -1 : 0);
+
+	if (grad != new_grad) {
+		grad = new_grad; //Update gradient
+		grad_count = 0; //Reset gradient counter
+	}
+	else {
+		grad_count++; //Increase gradient count
+	}
+
+	//New direction - extreme lies at the first point of the new gradient
+	bool extreme = false;
+	if (grad_count == N_gradient_count && current_grad != grad) {
+		if (current_grad == -1 || current_grad == 1) {
+			extreme = true;
+			extremes++;
+			LOG(2, "Max point: %ld", i - N_gradient_count);
+		}
+		current_grad = grad;
+	}
+
+	long k = i - N_gradient_count; //Integration point
+	if (k < 0) {
+		return false;
+	}
+	int16_t xk = getRing(k);
+
+	if (!extreme) {
+		if (started) {
+			addToHalfWave(xk);
+		}
+		return false;
+	}
+
+	//Extreme - close current half-wave and start the next one
+	bool back = (k > 0) && grad * (xk - getRing(k - 1)) > 0; //Previous sample is more extreme
+	int16_t xe = back ? getRing(k - 1) : xk;
+	bool ready = false;
+	if (started) {
+		if (!back) {
+			addToHalfWave(xk);
+		}
+		cur.x_end = xe;
+		if (pending) {
+			emitHalfWave((cur.x_start + cur.x_end) / 2); //Offset of the next half-wave is now known
+			ready = true;
+		}
+		last = cur;
+		pending = true;
+	}
+	startHalfWave(xe);
+	if (back) {
+		addToHalfWave(xk);
+	}
+	started = true;
+
+	return ready;
+}
+#pragma endregion
+
+#pragma region bool WaveStream::Flush()
+/* Close the record
+Input: /
+Output: bool - true when the last half-wave height and period are ready
+Description: finish the pending half-wave using its own offset at both ends, as WaveAnalyser::calculateWaves does for the last half-wave
+*/
+bool WaveStream::Flush() {
+	if (!pending) {
+		return false;
+	}
+	emitHalfWave((last.x_start + last.x_end) / 2);
+	pending = false;
+	return true;
+}
+#pragma endregion
+
+#pragma region void WaveStream::emitHalfWave(int16_t offset2)
+/* Calculate displacement of the pending half-wave
+Input: int16_t offset2 - offset at the end of the half-wave
+Output: /
+Description:
+* Double trapezoidal integration of y_j = x_j - offset_j over m + 1 samples equals
+  dt^2 * (sum (m - j) y_j - (m/2 + 1/4) y_0 + y_m / 4)
+* Offset is linearly interpolated from offset1 to offset2, its weighted sum is (m + 1)/6 * ((2m + 1) offset1 + (m - 1) offset2)
+* Update height and half period
+*/
+void WaveStream::emitHalfWave(int16_t offset2) {
+
+	int16_t offset1 = (last.x_start + last.x_end) / 2;
+	float dt = getDt();
+	float m = (float)(last.n - 1);
+
+	float sum = m * (float)last.s0 - (float)last.s1 - (m + 1.0f) / 6.0f * ((2.0f * m + 1.0f) * (float)offset1 + (m - 1.0f) * (float)offset2);
+	sum += -(m / 2.0f + 0.25f) * (float)(last.x_start - offset1) + 0.25f * (float)(last.x_end - offset2);
+	float d = dt * dt * sum * GRAV_CONSTANT / 1000.0f;
+
+	height = fabs(d);
+	half_period = dt * (float)(last.n - 1);
+}
+#pragma endregion
+
+#pragma region Half-wave accumulators
+void WaveStream::startHalfWave(int16_t _x) {
+	cur.s0 = 0;
+	cur.s1 = 0;
+	cur.n = 0;
+	cur.x_start = _x;
+	cur.x_end = _x;
+	addToHalfWave(_x);
+}
+
+void WaveStream::addToHalfWave(int16_t _x) {
+	cur.s0 += _x;
+	cur.s1 += (int64_t)cur.n * _x;
+	cur.n++;
+}
+
+int16_t WaveStream::getRing(long i) {
+	return ring[i % N_ring];
+}
+#pragma endregion
+
+// GET FUNCTIONS
+
+float WaveStream::getHeight() {
+	return height;
+}
+
+float WaveStream::getHalfPeriod() {
+	return half_period;
+}
+
+float WaveStream::getDt() {
+	if (n_elements == 0) {
+		return 0.0;
+	}
+	return dt_sum / (float)n_elements;
+}
+
+long WaveStream::getElements() {
+	return n_elements;
+}
+
+int WaveStream::getExtremes() {
+	return extremes;
+}
@@ -0,0 +1,69 @@
+/* WAVE STREAM class - one-pass wave analysis used in the wave_analyser.h library
+* Each new acceleration sample is low-pass filtered, checked for extrema and integrated as it arrives.
+* Only a short look-ahead ring of about 2 * n_grad samples is kept, instead of the full MotionArray record.
+* Half-wave heights are integrated with running sums, so the result equals MotionArray::CalculateDisplacement
+* with linearly interpolated offsets, without storing the samples between the extrema.
+*/
+
+#ifndef _WAVE_STREAM_H_
+#define _WAVE_STREAM_H_
+
+#include <Arduino.h>
+#include "array_structures.h" //Biquad filter, GRAV_CONSTANT and debug logging
+
+/* One half-wave between two extrema, described by sufficient statistics for the double integration */
+struct HalfWave {
+	int32_t s0; //Sum of samples
+	int64_t s1; //Sum of samples weighted by their relative index
+	int32_t n; //Number of samples, both extrema included
+	int16_t x_start; //Value at the starting extremum
+	int16_t x_end; //Value at the ending extremum
+};
+
+class WaveStream {
+public:
+
+	WaveStream(int n_grad, int n_grad_count, float cutoff_freq, float sampling_time, int order); //Constructor
+	void Init(); //Initialization
+	bool AddElement(int16_t _x, float _dt); //Add new sample - return true when new half-wave is ready
+	bool Flush(); //Close the record - return true when the last half-wave is ready
+
+	float getHeight(); //Height of the last finished half-wave
+	float getHalfPeriod(); //Period of the last finished half-wave
+	float getDt(); //Average time interval
+	long getElements(); //Number of added samples
+	int getExtremes(); //Number of detected extremes
+
+private:
+
+	int16_t *ring; //Look-ahead ring of filtered samples
+	int N_ring; //Length of ring
+	int N_gradient; //Length of gradient calculation
+	int N_gradient_count; //Number of points with the same gradient to consider as new direction
+
+	Biquad *filter; //Low pass filter
+
+	long n_elements = 0; //Number of elements added
+	float dt_sum = 0.0; //Sum of time intervals
+	int16_t x_first = 0; //First filtered sample - used for gradient at the start of the record
+
+	int grad = 0; //Current motion gradient
+	int current_grad = 0; //Current steady direction of movement
+	int grad_count = 0; //Gradient counter
+	int extremes = 0; //Number of detected extremes
+
+	bool started = false; //Denotes if the first extreme was found
+	bool pending = false; //Denotes if a half-wave waits for the next offset
+	HalfWave cur; //Half-wave currently being integrated
+	HalfWave last; //Finished half-wave waiting for the offset of the next one
+
+	float height = 0.0; //Last emitted height
+	float half_period = 0.0; //Last emitted half period
+
+	int16_t getRing(long i); //Filtered sample at absolute index i
+	void startHalfWave(int16_t _x);
+	void addToHalfWave(int16_t _x);
+	void emitHalfWave(int16_t offset2);
+};
+
+#endif
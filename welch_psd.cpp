@@ -0,0 +1,157 @@
+#include "welch_psd.h"
+
+#pragma region WelchPSD::WelchPSD(int segment, int decimation, float f_max)
+/* WelchPSD constructor
+Input: int segment - segment length, power of 2, int decimation - decimation factor, float f_max - highest stored frequency
+Description: allocate segment, overlap and density arrays. Number of bins is known only after sampling time is measured,
+so density is allocated for the full half segment and only bins up to f_max are used.
+*/
+WelchPSD::WelchPSD(int segment_length, int decimation, float f_max_) {
+
+	N_segment = segment_length;
+	N_decimation = decimation;
+	f_max = f_max_;
+	N_bins = N_segment / 2;
+
+	segment = (int16_t *)malloc((N_segment)*sizeof(int16_t));
+	overlap = (int16_t *)malloc((N_segment / 2)*sizeof(int16_t));
+	psd = (float *)malloc((N_bins)*sizeof(float));
+
+	Init();
+}
+#pragma endregion
+
+#pragma region void WelchPSD::Init()
+/* Initialization
+Input: /
+Output: /
+Description: reset accumulated density and counters
+*/
+void WelchPSD::Init() {
+	for (int i = 0; i < N_bins; i++) {
+		psd[i] = 0.0;
+	}
+	dec_sum = 0;
+	dec_count = 0;
+	fill = 0;
+	segments = 0;
+	n_elements = 0;
+	dt_sum = 0.0;
+}
+#pragma endregion
+
+#pragma region bool WelchPSD::AddElement(int16_t _x, float _dt)
+/* Add new element
+Input: int16_t _x - new acceleration in mg, float _dt - new time interval
+Output: bool - true when a segment was transformed
+Description:
+* Average N_decimation samples into one segment sample
+* The first segment is collected whole, later segments need only half of new samples
+* When the segment is full, store its second half as overlap for the next one and transform it
+*/
+bool WelchPSD::AddElement(int16_t _x, float _dt) {
+
+	n_elements++;
+	dt_sum += _dt;
+	dec_sum += _x;
+	dec_count++;
+	if (dec_count < N_decimation) {
+		return false;
+	}
+
+	int16_t xd = (int16_t)(dec_sum / N_decimation);
+	dec_sum = 0;
+	dec_count = 0;
+
+	int half = N_segment / 2;
+	if (segments == 0) {
+		segment[fill++] = xd;
+		if (fill < N_segment) {
+			return false;
+		}
+	}
+	else {
+		segment[half + fill++] = xd;
+		if (fill < half) {
+			return false;
+		}
+		for (int i = 0; i < half; i++) {
+			int16_t tmp = overlap[i];
+			overlap[i] = segment[half + i];
+			segment[i] = tmp;
+		}
+	}
+
+	if (segments == 0) {
+		for (int i = 0; i < half; i++) {
+			overlap[i] = segment[half + i];
+		}
+	}
+	fill = 0;
+	transform();
+	return true;
+}
+#pragma endregion
+
+#pragma region void WelchPSD::transform()
+/* Transform segment
+Input: /
+Output: /
+Description:
+* Remove mean value and apply Hann window
+* Scale to full Q15 range and calculate real FFT in place
+* Update running average of one-sided acceleration density 2 |X|^2 dt / (n U) for each stored bin
+*/
+void WelchPSD::transform() {
+
+	int32_t sum = 0;
+	for (int i = 0; i < N_segment; i++) {
+		sum += segment[i];
+	}
+	int16_t mean = (int16_t)(sum / N_segment);
+
+	for (int i = 0; i < N_segment; i++) {
+		int16_t w = (int16_t)((32767 - FixedFFT::Cos(i, N_segment)) >> 1);
+		segment[i] = FixedFFT::Multiply(segment[i] - mean, w);
+	}
+
+	int exponent = FixedFFT::Normalize(segment, N_segment);
+	exponent += FixedFFT::Real(segment, N_segment);
+
+	float dt = (float)N_decimation * dt_sum / (float)n_elements;
+	float scale = ldexpf(1.0, 2 * exponent) * (GRAV_CONSTANT / 1000.0) * (GRAV_CONSTANT / 1000.0) * 2.0 * dt / ((float)N_segment * HANN_POWER);
+
+	for (int k = 1; k < N_bins && (float)k * getDf() <= f_max; k++) {
+		float re = (float)segment[2 * k];
+		float im = (float)segment[2 * k + 1];
+		psd[k] += ((re * re + im * im) * scale - psd[k]) / (float)(segments + 1);
+	}
+	segments++;
+	LOG(2, "Welch segment: %d", segments);
+}
+#pragma endregion
+
+// GET FUNCTIONS
+
+float *WelchPSD::getPSD() {
+	return psd;
+}
+
+int WelchPSD::getBins() {
+	return N_bins;
+}
+
+float WelchPSD::getDf() {
+	if (n_elements == 0) {
+		return 0.0;
+	}
+	return 1.0 / ((float)N_segment * (float)N_decimation * dt_sum / (float)n_elements);
+}
+
+int WelchPSD::getSegments() {
+	return segments;
+}
+
+float WelchPSD::getTime() {
+	return dt_sum;
+}
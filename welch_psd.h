@@ -0,0 +1,53 @@
+/* WELCH PSD class - running power spectral density used in the wave_analyser.h library
+* Samples are block-averaged to a lower rate, then Hann windowed segments with 50 % overlap are transformed with
+* the fixed point FFT (fixed_fft.h) as soon as they are complete, and their densities are accumulated.
+* Only one segment, the overlapping half of the previous one and the density bins up to f_max are kept in RAM,
+* so the record length is limited only by time, and the calculation is spread over the acquisition.
+*/
+
+#ifndef _WELCH_PSD_H_
+#define _WELCH_PSD_H_
+
+#include <Arduino.h>
+#include "fixed_fft.h" //Q15 FFT
+#include "array_structures.h" //GRAV_CONSTANT and debug logging
+
+#define WELCH_SEGMENT 256 //Length of segment after decimation, power of 2
+#define WELCH_DECIMATION 25 //Number of samples averaged into one segment sample, 100 Hz -> 4 Hz
+#define WELCH_F_MAX 0.6 //Highest stored frequency, Hz
+
+class WelchPSD {
+public:
+
+	WelchPSD(int segment = WELCH_SEGMENT, int decimation = WELCH_DECIMATION, float f_max = WELCH_F_MAX); //Constructor
+	void Init(); //Initialization
+	bool AddElement(int16_t _x, float _dt); //Add new acceleration in mg - return true when a segment was transformed
+
+	float *getPSD(); //Averaged acceleration density in (m/s^2)^2/Hz, bins from 0 Hz
+	int getBins(); //Number of density bins
+	float getDf(); //Bin width in Hz
+	int getSegments(); //Number of averaged segments
+	float getTime(); //Duration of added data in s
+
+private:
+
+	int N_segment; //Segment length
+	int N_decimation; //Decimation factor
+	int N_bins; //Number of stored bins
+
+	int16_t *segment; //Segment buffer - transformed in place
+	int16_t *overlap; //Second half of previous segment
+	float *psd; //Running average of density
+
+	int32_t dec_sum = 0; //Sum of samples for block averaging
+	int dec_count = 0; //Number of samples in the current block
+	int fill = 0; //Number of new samples in the segment
+	int segments = 0; //Number of transformed segments
+	long n_elements = 0; //Number of added samples
+	float dt_sum = 0.0; //Sum of time intervals
+	float f_max; //Highest stored frequency
+
+	void transform(); //Window, transform and accumulate a full segment
+};
+
+#endif
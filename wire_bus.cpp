@@ -0,0 +1,63 @@
+#include "wire_bus.h"
+
+#pragma region WireBus::WireBus(TwoWire *wire)
+/* WireBus constructor
+Input: TwoWire *wire - I2C bus, must be started with begin()
+*/
+WireBus::WireBus(TwoWire *_wire) {
+	wire = _wire;
+}
+#pragma endregion
+
+void WireBus::beginTransmission(uint8_t address) {
+	wire->beginTransmission(address);
+}
+
+size_t WireBus::write(const uint8_t *data, size_t size) {
+	return wire->write(data, size);
+}
+
+uint8_t WireBus::endTransmission(bool stop) {
+	return wire->endTransmission(stop);
+}
+
+uint8_t WireBus::requestFrom(uint8_t address, uint8_t size) {
+	return wire->requestFrom(address, size);
+}
+
+int WireBus::available() {
+	return wire->available();
+}
+
+int WireBus::read() {
+	return wire->read();
+}
+
+#pragma region bool WireBus::isAsync()
+/* Are asynchronous transfers supported
+Output: bool - true on STM32L0
+*/
+bool WireBus::isAsync() {
+#ifdef ARDUINO_ARCH_STM32L0
+	return true;
+#else
+	return false;
+#endif
+}
+#pragma endregion
+
+#pragma region bool WireBus::transfer(uint8_t address, uint8_t *tx, uint8_t tx_size, uint8_t *rx, uint8_t rx_size, volatile uint8_t *status, I2CTransferCallback callback)
+/* Asynchronous transfer
+Input: uint8_t address - slave address, uint8_t *tx, uint8_t tx_size - data to write, uint8_t *rx, uint8_t rx_size - read data,
+       volatile uint8_t *status - written at the end, I2CTransferCallback callback - called from interrupt at the end
+Output: bool - false if the bus refuses the transfer, always false without asynchronous transfers
+*/
+bool WireBus::transfer(uint8_t address, uint8_t *tx, uint8_t tx_size, uint8_t *rx, uint8_t rx_size, volatile uint8_t *status,
+	I2CTransferCallback callback) {
+#ifdef ARDUINO_ARCH_STM32L0
+	return wire->transfer(address, tx, tx_size, rx, rx_size, status, callback);
+#else
+	return false;
+#endif
+}
+#pragma endregion
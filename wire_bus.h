@@ -0,0 +1,34 @@
+/* WIRE BUS class - I2CBus on the Arduino Wire library used in the MPU9250.h library and the main sketch
+* Blocking calls are forwarded to TwoWire. On STM32L0 transfer() runs on the core's asynchronous Wire transactions
+* (interrupt and DMA driven), other boards have only blocking calls.
+*/
+
+#ifndef _WIRE_BUS_H_
+#define _WIRE_BUS_H_
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "i2c_bus.h" //Bus interface
+
+class WireBus : public I2CBus {
+public:
+
+	WireBus(TwoWire *wire = &Wire); //Constructor
+
+	void beginTransmission(uint8_t address);
+	size_t write(const uint8_t *data, size_t size);
+	uint8_t endTransmission(bool stop);
+	uint8_t requestFrom(uint8_t address, uint8_t size);
+	int available();
+	int read();
+
+	bool isAsync();
+	bool transfer(uint8_t address, uint8_t *tx, uint8_t tx_size, uint8_t *rx, uint8_t rx_size, volatile uint8_t *status,
+		I2CTransferCallback callback);
+
+private:
+
+	TwoWire *wire; //Arduino I2C bus, must be started with begin()
+};
+
+#endif
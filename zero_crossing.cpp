@@ -0,0 +1,107 @@
+#include "zero_crossing.h"
+
+#pragma region ZeroCrossing::ZeroCrossing()
+/* ZeroCrossing constructor */
+ZeroCrossing::ZeroCrossing() {
+	Init();
+}
+#pragma endregion
+
+#pragma region void ZeroCrossing::Init()
+/* Initialization
+Input: /
+Output: /
+Description: reset crossing state and summary parameters
+*/
+void ZeroCrossing::Init() {
+	started = false;
+	first = true;
+	x_prev = 0;
+	t = 0.0;
+	t_cross = 0.0;
+	crest = 0;
+	trough = 0;
+	waves = 0;
+	period_sum = 0.0;
+	height = 0.0;
+	period = 0.0;
+	h_max = 0.0;
+	t_max = 0.0;
+}
+#pragma endregion
+
+#pragma region bool ZeroCrossing::AddElement(int16_t _x, float _dt)
+/* Add new element
+Input: int16_t _x - new heave sample in mm, float _dt - time interval from the previous sample
+Output: bool - true when a wave is finished
+Description:
+* Detect upcrossing - previous sample below zero and new sample at or above zero
+* Interpolate crossing time between the two samples
+* On upcrossing finish the current wave, if one was started, and update summary parameters
+* Track crest and trough of the current wave
+*/
+bool ZeroCrossing::AddElement(int16_t _x, float _dt) {
+
+	bool finished = false;
+	if (first) {
+		first = false;
+	}
+	else {
+		t += _dt;
+		if (x_prev < 0 && _x >= 0) {
+			float t_new = t - _dt * (float)_x / (float)(_x - x_prev); //Interpolated crossing
+
+			if (started) {
+				height = (float)(crest - trough) / 1000.0;
+				period = t_new - t_cross;
+				period_sum += period;
+				waves++;
+				if (height > h_max) {
+					h_max = height;
+					t_max = period;
+				}
+				finished = true;
+			}
+			started = true;
+			t_cross = t_new;
+			crest = _x;
+			trough = _x;
+		}
+	}
+
+	if (_x > crest) {
+		crest = _x;
+	}
+	if (_x < trough) {
+		trough = _x;
+	}
+	x_prev = _x;
+	return finished;
+}
+#pragma endregion
+
+// GET FUNCTIONS
+
+float ZeroCrossing::getHeight() {
+	return height;
+}
+
+float ZeroCrossing::getPeriod() {
+	return period;
+}
+
+int ZeroCrossing::getWaves() {
+	return waves;
+}
+
+float ZeroCrossing::getHmax() {
+	return h_max;
+}
+
+float ZeroCrossing::getTmax() {
+	return t_max;
+}
+
+float ZeroCrossing::getTz() {
+	return (waves > 0) ? period_sum / (float)waves : 0.0;
+}
@@ -0,0 +1,46 @@
+/* ZERO CROSSING class - zero-upcrossing wave-by-wave analysis used in the wave_analyser.h library
+* A wave is the heave record between two consecutive upward crossings of zero. Its height H is the difference between
+* the highest crest and the lowest trough inside it, its period T is the time between the crossings. Crossing times are
+* linearly interpolated between samples. Samples are processed one by one in a single pass - only the running crest,
+* trough and the last crossing are kept. Heave must have zero mean, e.g. after MotionArray::IntegrateDisplacement.
+* Summary parameters: Hmax - highest wave and Tmax - its period, Tz - mean period.
+*/
+
+#ifndef _ZERO_CROSSING_H_
+#define _ZERO_CROSSING_H_
+
+#include <Arduino.h>
+
+class ZeroCrossing {
+public:
+
+	ZeroCrossing(); //Constructor
+	void Init(); //Initialization
+	bool AddElement(int16_t _x, float _dt); //Add new heave sample in mm - return true when a wave is finished
+
+	float getHeight(); //Height of the last finished wave in m
+	float getPeriod(); //Period of the last finished wave in s
+	int getWaves(); //Number of finished waves
+	float getHmax(); //Highest wave in m
+	float getTmax(); //Period of the highest wave in s
+	float getTz(); //Mean zero-upcrossing period in s
+
+private:
+
+	bool started = false; //Denotes if the first upcrossing was found
+	bool first = true; //Denotes the first sample
+	int16_t x_prev = 0; //Previous sample
+	float t = 0.0; //Time of the current sample
+	float t_cross = 0.0; //Time of the last upcrossing
+	int16_t crest = 0; //Highest sample of the current wave
+	int16_t trough = 0; //Lowest sample of the current wave
+
+	int waves = 0; //Number of finished waves
+	float period_sum = 0.0; //Sum of wave periods
+	float height = 0.0; //Last finished wave
+	float period = 0.0;
+	float h_max = 0.0; //Highest wave
+	float t_max = 0.0;
+};
+
+#endif